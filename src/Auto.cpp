@@ -9,24 +9,35 @@
  */
 
 #include <Auto.hpp>
-#include <algorithm>
 
+#include "AutoSchema.hpp"
 #include "RobotMap.hpp"
 
+// Limits and argument schemas are in AutoSchema.hpp (the host tools use the same ones)
+
 //////////////////////////////////////////////////////////////
 /// DriveAutoCommand
 //////////////////////////////////////////////////////////////
 
-void DriveAutoCommand::start(std::vector<std::string> args){
+std::vector<team2655::ArgumentSpec> DriveAutoCommand::getArgumentSpecs(){
+	return AutoSchema::driveArguments();
+}
+
+bool DriveAutoCommand::prepare(const std::vector<team2655::AutoArgument> &args){
+	// First arg is the distance in meters (positive is forward)
+	return profile.generate(args[0].getDouble(), AutoSchema::driveLimits);
+}
 
-	// First arg should be direction (1 or -1)
-	// Second arg should be time in seconds. Use the builtin timeout.
-	this->setTimeout(1000 * stod(args[1]));
+void DriveAutoCommand::start(const std::vector<team2655::AutoArgument> &){
+	// Done at the end of the profile. Use the builtin timeout.
+	this->setTimeoutSeconds(profile.getDuration());
 }
 
 void DriveAutoCommand::process(){
-	// Drive the robot
-	RobotMap::robotDrive->ArcadeDrive(stoi(this->arguments[0]) * 0.5, 0, false);
+	// Drive at the profile's velocity for the time since the command started
+	// The motors are inverted (see Robot::RobotInit) so a negative speed is forward
+	double velocity = profile.sample((tick.now - startTime) / 1e6).velocity;
+	RobotMap::robotDrive->ArcadeDrive(-velocity / AutoSchema::DRIVE_FULL_SPEED, 0, false);
 }
 
 void DriveAutoCommand::complete(){
@@ -38,16 +49,24 @@ void DriveAutoCommand::complete(){
 /// RotateAutoCommand
 //////////////////////////////////////////////////////////////
 
-void RotateAutoCommand::start(std::vector<std::string> args){
+std::vector<team2655::ArgumentSpec> RotateAutoCommand::getArgumentSpecs(){
+	return AutoSchema::rotateArguments();
+}
+
+bool RotateAutoCommand::prepare(const std::vector<team2655::AutoArgument> &args){
+	// First arg is the angle in degrees (positive is counter clockwise)
+	return profile.generate(args[0].getDouble(), AutoSchema::rotateLimits);
+}
 
-	// First arg should be direction (1 or -1)
-	// Second arg should be time in seconds. Use builtin timeout.
-	this->setTimeout(1000 * stod(args[1]));
+void RotateAutoCommand::start(const std::vector<team2655::AutoArgument> &){
+	// Done at the end of the profile. Use builtin timeout.
+	this->setTimeoutSeconds(profile.getDuration());
 }
 
 void RotateAutoCommand::process(){
-	// Rotate in a certain direction
-	RobotMap::robotDrive->ArcadeDrive(0, stoi(this->arguments[0]) * 0.5, false); // First arg is either -1 or 1
+	// With the inverted motors a positive rotation is counter clockwise
+	double velocity = profile.sample((tick.now - startTime) / 1e6).velocity;
+	RobotMap::robotDrive->ArcadeDrive(0, velocity / AutoSchema::ROTATE_FULL_SPEED, false);
 }
 
 void RotateAutoCommand::complete(){
@@ -59,10 +78,14 @@ void RotateAutoCommand::complete(){
 /// DelayAutoCommand
 //////////////////////////////////////////////////////////////
 
-void DelayAutoCommand::start(std::vector<std::string> args){
+std::vector<team2655::ArgumentSpec> DelayAutoCommand::getArgumentSpecs(){
+	return AutoSchema::delayArguments();
+}
+
+void DelayAutoCommand::start(const std::vector<team2655::AutoArgument> &args){
 
 	// First arg should be time in seconds. Use builtin timeout
-	this->setTimeout(1000 * stod(args[0]));
+	this->setTimeoutSeconds(args[0].getDouble());
 }
 
 void DelayAutoCommand::process(){
@@ -77,29 +100,65 @@ void DelayAutoCommand::complete(){
 }
 
 //////////////////////////////////////////////////////////////
-/// ExampleAutoManager
+/// SquareAutoCommand
 //////////////////////////////////////////////////////////////
 
-std::string ExampleAutoManager::getScriptDir(){
-	return "/auto-scripts"; // A path on the RoboRIO's file system. Can be accessed via SFTP
+std::vector<team2655::ArgumentSpec> SquareAutoCommand::getArgumentSpecs(){
+	return AutoSchema::squareArguments();
 }
 
-std::unique_ptr<team2655::AutoCommand> ExampleAutoManager::getCommand(std::string commandName){
-	// This will return a unique_ptr to a new AutoCommand based on the command name.
-	// Which specific implementation of AutoCommand is determined based on the commandName.
-	// This is how command names (strings) are mapped to the actual commands (AutoCommands)
-
-	// Convert commandName to upper case so all comparisons are case insensitive
-	std::transform(commandName.begin(), commandName.end(), commandName.begin(), ::toupper);
+bool SquareAutoCommand::prepare(const std::vector<team2655::AutoArgument> &args){
+	return AutoSchema::checkSquareArguments(args);
+}
 
-	// Now upper case so all comparisons should also be upper case
-	if(commandName == "DRIVE"){
-		return std::unique_ptr<team2655::AutoCommand>(new DriveAutoCommand());
-	}else if(commandName == "ROTATE"){
-		return std::unique_ptr<team2655::AutoCommand>(new RotateAutoCommand());
-	}else if(commandName == "DELAY"){
-		return std::unique_ptr<team2655::AutoCommand>(new DelayAutoCommand());
-	}else{
-		return std::unique_ptr<team2655::AutoCommand>(nullptr); // For any unknown command
+void SquareAutoCommand::run(){
+	ROUTINE_BEGIN();
+
+	for(side = 0; side < 4; side++){
+		// Drive one side. The drive has to be updated every tick.
+		segmentEnd = tick.now + (int64_t)(1000000 * arguments[0].getDouble());
+		while(tick.now < segmentEnd){
+			RobotMap::robotDrive->ArcadeDrive(0.5, 0, false);
+			ROUTINE_YIELD();
+		}
+
+		// Let the robot settle before turning
+		RobotMap::robotDrive->ArcadeDrive(0, 0, false);
+		ROUTINE_DELAY(0.25);
+
+		segmentEnd = tick.now + (int64_t)(1000000 * arguments[1].getDouble());
+		while(tick.now < segmentEnd){
+			RobotMap::robotDrive->ArcadeDrive(0, 0.5, false);
+			ROUTINE_YIELD();
+		}
 	}
+
+	ROUTINE_END();
+}
+
+void SquareAutoCommand::complete(){
+	// Stop driving
+	RobotMap::robotDrive->ArcadeDrive(0, 0, false);
+}
+
+//////////////////////////////////////////////////////////////
+/// ExampleAutoManager
+//////////////////////////////////////////////////////////////
+
+ExampleAutoManager::ExampleAutoManager(){
+	// Register each command under the name used for it in scripts.
+	// Names are case insensitive and are resolved when a script is loaded, so an unknown command fails the load.
+	registerCommand<DriveAutoCommand>(AutoSchema::DRIVE);
+	registerCommand<RotateAutoCommand>(AutoSchema::ROTATE);
+	registerCommand<DelayAutoCommand>(AutoSchema::DELAY);
+	registerCommand<SquareAutoCommand>(AutoSchema::SQUARE);
+
+	// Conditions scripts can wait for (WAIT_UNTIL,name). Ex. end a DRIVE early if the robot is pushing against something:
+	//     RACE / DRIVE,3 / WAIT_UNTIL,DRIVE_STALLED / END
+	registerCondition(AutoSchema::DRIVE_STALLED, [](){ return RobotMap::leftMaster->GetOutputCurrent(); },
+					  team2655::ConditionType::AtLeast, AutoSchema::DRIVE_STALLED_CURRENT);
+}
+
+std::string ExampleAutoManager::getScriptDir(){
+	return "/auto-scripts"; // A path on the RoboRIO's file system. Can be accessed via SFTP
 }
@@ -14,6 +14,8 @@
 #include <vector>
 #include <string>
 #include "team2655/autonomous.hpp"
+#include "team2655/motionprofile.hpp"
+#include "team2655/routine.hpp"
 
 #pragma once
 
@@ -24,9 +26,13 @@
  *     Rotate
  *     Wait
  *
- *     Each command overrides 3 methods: start, process, and complete
+ *     Each command overrides 4 methods: getArgumentSpecs, start, process, and complete
+ *     The getArgumentSpecs method returns the arguments the command expects. The AutoManager uses this to parse
+ *       and check every line of a script when it is loaded, so a bad script is rejected before the match instead of
+ *       failing while a command is running.
  *     The start method is called by the auto manager when the command first starts executing. The args given
- *       to the start function are stored in the AutoCommand's arguments member variable.
+ *       to the start function are stored in the AutoCommand's arguments member variable. They are already
+ *       converted to the types from getArgumentSpecs (use getInt, getDouble, getBool).
  *     The process function is called by the AutoManager while the command is running. This is where periodic
  *       tasks should be executed for a command. This will be called as frequently as the AutoManager's process
  *       function is called.
@@ -34,37 +40,73 @@
  *       Normally commands will run their own complete method from their process method when the command has
  *       accomplished its task, however calling killAuto from the AutoManager will also run the command's complete
  *       function. This function should stop any in-progress tasks from the command.
+ *     Commands can also override prepare to do work that only depends on their arguments when the script is loaded
+ *       (DRIVE and ROTATE generate their motion profiles there so process only looks up the profile).
+ *     Command objects are created when the script is loaded and reused if the script is run again. A command that keeps
+ *       its own state (other than its arguments and timeout) should also override reset to clear that state.
  *
  *
- * Each command will be mapped to a string by the getCommand function of the custom AutoManager
+ * Commands that are a sequence of steps can instead extend RoutineCommand and write the whole sequence in run
+ *   (see SquareAutoCommand and team2655/routine.hpp).
+ *
+ * Each command is mapped to a name by registering it in the constructor of the custom AutoManager
  */
 
+/**
+ * Drive a distance (m, positive is forward) following an S-curve motion profile (open loop)
+ */
 class DriveAutoCommand : public team2655::AutoCommand{
-	void start(std::vector<std::string> args) override;
+	team2655::MotionProfile profile;
+
+	std::vector<team2655::ArgumentSpec> getArgumentSpecs() override;
+	bool prepare(const std::vector<team2655::AutoArgument> &args) override;
+	void start(const std::vector<team2655::AutoArgument> &args) override;
 	void process() override;
 	void complete() override;
 };
 
+/**
+ * Rotate an angle (degrees, positive is counter clockwise) following an S-curve motion profile (open loop)
+ */
 class RotateAutoCommand : public team2655::AutoCommand{
-	void start(std::vector<std::string> args) override;
+	team2655::MotionProfile profile;
+
+	std::vector<team2655::ArgumentSpec> getArgumentSpecs() override;
+	bool prepare(const std::vector<team2655::AutoArgument> &args) override;
+	void start(const std::vector<team2655::AutoArgument> &args) override;
 	void process() override;
 	void complete() override;
 };
 
 class DelayAutoCommand : public team2655::AutoCommand{
-	void start(std::vector<std::string> args) override;
+	std::vector<team2655::ArgumentSpec> getArgumentSpecs() override;
+	void start(const std::vector<team2655::AutoArgument> &args) override;
 	void process() override;
 	void complete() override;
 };
 
 /**
- * This is our custom auto manager. It overrides the two pure virtual functions
- * 		getCommand - creates a unique_ptr to a new custom AutoCommand based on
- * 		             a string (this is how strings are mapped to commands)
+ * Drives in a square: drive one side, stop, turn, repeated 4 times. Written as a routine.
+ */
+class SquareAutoCommand : public team2655::RoutineCommand{
+	// Routine state has to be members (locals are lost at each wait)
+	int side = 0;
+	int64_t segmentEnd = 0;
+
+	std::vector<team2655::ArgumentSpec> getArgumentSpecs() override;
+	bool prepare(const std::vector<team2655::AutoArgument> &args) override;
+	void run() override;
+	void complete() override;
+};
+
+/**
+ * This is our custom auto manager.
+ *      The constructor registers each command under a name (this is how strings are mapped to commands)
  *      getScriptDir - returns the path (as a string) to the directory where csv scripts are stored
  */
 class ExampleAutoManager : public team2655::AutoManager{
+public:
+	ExampleAutoManager();
 protected:
 	std::string getScriptDir() override;
-	std::unique_ptr<team2655::AutoCommand> getCommand(std::string commandName) override;
 };
@@ -0,0 +1,75 @@
+/**
+ * AutoSchema.hpp
+ *
+ * The robot's autonomous commands as scripts see them: names, arguments, and the limits they move with.
+ * Shared by the robot (Auto.cpp) and the host tools (tools/autoc.cpp, tools/autosim.cpp) so they always match.
+ * Nothing in here may depend on WPILib (the tools are built without it).
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <vector>
+#include "team2655/autonomous.hpp"
+#include "team2655/motionprofile.hpp"
+
+namespace AutoSchema{
+
+// Limits for the drive train's motion profiles and how fast it goes at full output. Measure these on the robot.
+static const team2655::ProfileLimits driveLimits(2.0, 3.0, 20.0);    // m/s, m/s^2, m/s^3
+static const team2655::ProfileLimits rotateLimits(180, 360, 3600);   // deg/s, deg/s^2, deg/s^3
+static const double DRIVE_FULL_SPEED = 3.0;   // m/s at an output of 1
+static const double ROTATE_FULL_SPEED = 570;  // deg/s at a rotation output of 1
+
+// Names used in scripts
+static const char *const DRIVE = "DRIVE";
+static const char *const ROTATE = "ROTATE";
+static const char *const DELAY = "DELAY";
+static const char *const SQUARE = "SQUARE";
+
+// Conditions for WAIT_UNTIL. Register them in this order (compiled scripts store conditions by index).
+static const char *const DRIVE_STALLED = "DRIVE_STALLED";
+static const double DRIVE_STALLED_CURRENT = 40; // Amps on the left master
+
+/**
+ * DRIVE,distance - drive distance meters (positive is forward) on a motion profile
+ */
+inline std::vector<team2655::ArgumentSpec> driveArguments(){
+	return { {"distance", team2655::ArgumentType::Double} };
+}
+
+/**
+ * ROTATE,angle - turn angle degrees (positive is counter clockwise) on a motion profile
+ */
+inline std::vector<team2655::ArgumentSpec> rotateArguments(){
+	return { {"angle", team2655::ArgumentType::Double} };
+}
+
+/**
+ * DELAY,time - wait time seconds
+ */
+inline std::vector<team2655::ArgumentSpec> delayArguments(){
+	return { {"time", team2655::ArgumentType::Double} };
+}
+
+/**
+ * SQUARE,side time,turn time - drive in a square on timers
+ */
+inline std::vector<team2655::ArgumentSpec> squareArguments(){
+	return { {"side time", team2655::ArgumentType::Double}, {"turn time", team2655::ArgumentType::Double} };
+}
+
+/**
+ * Are SQUARE's times usable. They are converted to microseconds while running. Anything over a minute is a typo.
+ */
+inline bool checkSquareArguments(const std::vector<team2655::AutoArgument> &args){
+	for(const team2655::AutoArgument &arg : args){
+		if(!(arg.getDouble() >= 0 && arg.getDouble() <= 60))
+			return false;
+	}
+	return true;
+}
+
+}
@@ -10,16 +10,63 @@
 
 #include <OI.hpp>
 
+#include <DriverStation.h>
+
+#include <algorithm>
+
+#include "team2655/telemetry.hpp"
+
 Joystick* OI::js0 = nullptr;
 
+// The default configs are constexpr so they are computed by the compiler (nothing runs before main).
+// OI's configs start as these and can still be changed (or rebuilt with createAxisConfig) at runtime.
+
 // This is a cubic function config. See docs for details
-jshelper::AxisConfig OI::driveAxisConfig = team2655::jshelper::createAxisConfig(0.1, 0.5, 0);
+static constexpr jshelper::AxisConfig DEFAULT_DRIVE_AXIS_CONFIG = team2655::jshelper::createAxisConfig(0.1, 0.5, 0);
 
 // This is a deadband only config. See docs for details
-jshelper::AxisConfig OI::rotateAxisConfig = team2655::jshelper::createAxisConfig(0.1);
+static constexpr jshelper::AxisConfig DEFAULT_ROTATE_AXIS_CONFIG = team2655::jshelper::createAxisConfig(0.1);
+
+jshelper::AxisConfig OI::driveAxisConfig = DEFAULT_DRIVE_AXIS_CONFIG;
+jshelper::AxisConfig OI::rotateAxisConfig = DEFAULT_ROTATE_AXIS_CONFIG;
+
+const int OI::CONTROLLER_COUNT;
+
+InputSnapshot OI::rawInput;
+InputSnapshot OI::input;
+InputFilter OI::inputFilter;
 
 void OI::initControls(){
 	js0 = new Joystick(0);
+	configureInputFilter();
+}
+
+void OI::configureInputFilter(){
+	inputFilter.clear();
+	inputFilter.addCurve(0, 1, driveAxisConfig);
+	inputFilter.addCurve(0, 2, rotateAxisConfig);
+}
+
+void OI::update(){
+	DriverStation &ds = DriverStation::GetInstance();
+	rawInput.timeMicros = telemetry::nowMicros();
+	rawInput.controllerCount = CONTROLLER_COUNT;
+	for(int port = 0; port < CONTROLLER_COUNT; port++){
+		ControllerSnapshot &controller = rawInput.controllers[port];
+
+		// Counts are 0 while a controller is unplugged. Values past them are left at 0.
+		controller.axisCount = std::min(ds.GetStickAxisCount(port), ControllerSnapshot::MAX_AXES);
+		for(int axis = 0; axis < ControllerSnapshot::MAX_AXES; axis++)
+			controller.axes[axis] = (axis < controller.axisCount) ? ds.GetStickAxis(port, axis) : 0;
+
+		controller.buttonCount = std::min(ds.GetStickButtonCount(port), ControllerSnapshot::MAX_BUTTONS);
+		controller.buttons = ds.GetStickButtons(port); // Every button in one call
+
+		controller.povCount = std::min(ds.GetStickPOVCount(port), ControllerSnapshot::MAX_POVS);
+		for(int pov = 0; pov < ControllerSnapshot::MAX_POVS; pov++)
+			controller.povs[pov] = (pov < controller.povCount) ? ds.GetStickPOV(port, pov) : -1;
+	}
+	inputFilter.apply(rawInput, input);
 }
 
 void OI::destroyControls(){
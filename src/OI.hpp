@@ -12,6 +12,7 @@
 #pragma once
 
 #include "team2655/joystick.hpp"
+#include "team2655/inputfilter.hpp"
 
 #include <Joystick.h>
 
@@ -26,9 +27,27 @@ public:
 	static jshelper::AxisConfig driveAxisConfig;
 	static jshelper::AxisConfig rotateAxisConfig;
 
+	// Driver station ports 0 to CONTROLLER_COUNT - 1 are read every loop
+	static const int CONTROLLER_COUNT = 1;
+
+	// Every controller as read by update (once per loop)
+	static InputSnapshot rawInput;
+
+	// rawInput after inputFilter. Read this instead of the joysticks so everything in a loop sees the same values.
+	static InputSnapshot input;
+
+	// Curves, rate limits and smoothing applied to rawInput
+	static InputFilter inputFilter;
+
 	// Initialize objects for each Joystick or controller. Should be called in RobotInit after RobotMap::initHardware
 	static void initControls();
 
+	// Set up inputFilter from the axis configs. Call again after changing the configs.
+	static void configureInputFilter();
+
+	// Read every controller into rawInput then filter it into input. Call at the start of every periodic function.
+	static void update();
+
 	// Delete all the pointers in this class to avoid memory leaks. call from robot's destructor
 	static void destroyControls();
 };
@@ -34,6 +34,14 @@ void Robot::RobotInit() {
 	RobotMap::rightMaster->SetInverted(true);
 	RobotMap::rightSlave1->SetInverted(true);
 	RobotMap::rightSlave2->SetInverted(true);
+
+	// Parse every auto script now so nothing has to be read or parsed when auto starts.
+	// The watcher re-parses scripts that are changed over SFTP (no redeploy needed).
+	autoManager.preloadScripts();
+	autoManager.startWatching();
+
+	// Replaced every time the robot code starts. Copy it off with SFTP after a match.
+	telemetryLogger.start("/home/lvuser/telemetry.tlm");
 }
 
 void Robot::AutonomousInit() {
@@ -45,28 +53,53 @@ void Robot::AutonomousInit() {
 	RobotMap::rightSlave1->SetNeutralMode(NeutralMode::Brake);
 	RobotMap::rightSlave2->SetNeutralMode(NeutralMode::Brake);
 
-	// Load a script at the start of auto
+	// Select a script at the start of auto. It was already parsed in RobotInit so this only copies its list of commands.
+	// If it is not in the cache (ex. added before the watcher started) try loading it from the file.
 	// Note: Script names are case sensitive and must be a full file name (including the extension)
-	if(!autoManager.loadScript("Test.csv")){
+	if(!autoManager.selectScript("Test.csv") && !autoManager.loadScript("Test.csv")){
 		// If the auto manager fails to load the script, manually insert a fallback
 		// This is likely due to a missing script, wrong directory, or occasionally incorrect permissions for the script
 
 		// Make sure there are no commands that could have been loaded (should not be possible, but...)
 		autoManager.clearCommands();
 		// Insert a script
-		autoManager.addCommands({"DRIVE", "ROTATE"}, {{"-1", "1"}, {"-1", "0.5"}});
+		autoManager.addCommands({"DRIVE", "ROTATE"}, {{"1.5"}, {"-90"}});
 	}
+
+	if(useExecutor)
+		autoExecutor.start();
 }
 
 void Robot::AutonomousPeriodic() {
+	int64_t loopStart = telemetry::nowMicros();
+	OI::update();
+
+	if(useExecutor){
+		// The executor thread is driving. Only touch the drive once it is done with it.
+		ExecutorStatus status = autoExecutor.getStatus();
+		if(status.finished)
+			RobotMap::robotDrive->ArcadeDrive(0, 0, false);
+		logTelemetry(1, loopStart, status.commandIndex, 0, 0);
+		return;
+	}
+
 	// Have the auto manager process the current command
 	if(!autoManager.process()){
 		// When this returns false it has reached the end of the script
 		RobotMap::robotDrive->ArcadeDrive(0, 0, false); // Make sure this is updated frequently (avoids warnings)
 	}
+	logTelemetry(1, loopStart, autoManager.getCurrentCommandIndex(), 0, 0);
+}
+
+void Robot::DisabledInit() {
+	// Stop auto if it is still running (completes the current command)
+	autoExecutor.kill();
 }
 
 void Robot::TeleopInit() {
+	// Stop auto if it is still running (ex. practice mode going straight to teleop)
+	autoExecutor.kill();
+
 	// Driving is more natural with coast mode
 	RobotMap::leftMaster->SetNeutralMode(NeutralMode::Coast);
 	RobotMap::leftSlave1->SetNeutralMode(NeutralMode::Coast);
@@ -74,13 +107,36 @@ void Robot::TeleopInit() {
 	RobotMap::rightMaster->SetNeutralMode(NeutralMode::Coast);
 	RobotMap::rightSlave1->SetNeutralMode(NeutralMode::Coast);
 	RobotMap::rightSlave2->SetNeutralMode(NeutralMode::Coast);
+
+	// Start the rate limits from where the sticks are now (not where they were at the end of auto)
+	OI::inputFilter.reset();
 }
 
 void Robot::TeleopPeriodic() {
-	// Get the values from the AxisConfigurations stored in OI
-	double speed = jshelper::getAxisValue(OI::driveAxisConfig, OI::js0->GetRawAxis(1));
-	double rotation = -0.5 * jshelper::getAxisValue(OI::rotateAxisConfig, OI::js0->GetRawAxis(2));
+	int64_t loopStart = telemetry::nowMicros();
+	OI::update();
+
+	// Already shaped (and rate limited) by OI's input filter
+	double speed = OI::input.controllers[0].axes[1];
+	double rotation = -0.5 * OI::input.controllers[0].axes[2];
 	RobotMap::robotDrive->ArcadeDrive(speed, rotation, false);
+
+	logTelemetry(2, loopStart, -1, speed, rotation);
+}
+
+void Robot::logTelemetry(int mode, int64_t loopStart, int command, double speed, double rotation) {
+	// Only copies the values into a queue. The file is written by a background thread.
+	telemetryLogger.log({
+		(double)mode,
+		(double)(telemetry::nowMicros() - loopStart),
+		(double)command,
+		OI::rawInput.controllers[0].axes[1],
+		OI::rawInput.controllers[0].axes[2],
+		speed,
+		rotation,
+		RobotMap::leftMaster->Get(),
+		RobotMap::rightMaster->Get()
+	});
 }
 
 START_ROBOT_CLASS(Robot)
@@ -15,14 +15,37 @@
 
 #include <IterativeRobot.h>
 #include "Auto.hpp"
+#include "team2655/executor.hpp"
+#include "team2655/telemetry.hpp"
 
 class Robot : public frc::IterativeRobot {
 public:
 	void RobotInit() override;
+	void DisabledInit() override;
 	void AutonomousInit() override;
 	void AutonomousPeriodic() override;
 	void TeleopInit() override;
 	void TeleopPeriodic() override;
 private:
 	ExampleAutoManager autoManager;
+
+	// Run auto on its own 200Hz real time thread instead of in AutonomousPeriodic (20ms)
+	bool useExecutor = false;
+	team2655::AutoExecutor autoExecutor{autoManager, 200};
+
+	// Logged every periodic call (see logTelemetry). Decode with tools/telemetry2csv.
+	team2655::TelemetryLogger telemetryLogger{{
+		{"mode", 1},           // 1 for auto, 2 for teleop
+		{"loop_us", 1},        // Time spent in the periodic function
+		{"command", 1},        // Index of the running auto command
+		{"axis_speed"},        // Raw joystick axes
+		{"axis_rotate"},
+		{"speed"},             // ArcadeDrive arguments (teleop only, auto commands drive directly)
+		{"rotation"},
+		{"left_output"},       // What the motors were set to
+		{"right_output"}
+	}};
+
+	// Add one record to the telemetry log
+	void logTelemetry(int mode, int64_t loopStart, int command, double speed, double rotation);
 };
@@ -0,0 +1,110 @@
+/**
+ * allocationcounter.cpp
+ * See allocationcounter.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "allocationcounter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+using namespace team2655;
+
+// Per thread so allocations by other threads (ex. the script watcher) do not count against the control loop
+static thread_local uint64_t allocations = 0;
+static thread_local uint64_t frees = 0;
+
+////////////////////////////////////////////////////////////////////////
+/// Global operator new / delete
+////////////////////////////////////////////////////////////////////////
+
+#ifdef TEAM2655_COUNT_ALLOCATIONS
+
+static void *countedAlloc(std::size_t size){
+	allocations++;
+	return std::malloc((size == 0) ? 1 : size);
+}
+
+static void countedFree(void *ptr){
+	if(ptr == nullptr)
+		return;
+	frees++;
+	std::free(ptr);
+}
+
+void *operator new(std::size_t size){
+	void *ptr = countedAlloc(size);
+	if(ptr == nullptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void *operator new[](std::size_t size){
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept{
+	return countedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept{
+	return countedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept{
+	countedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept{
+	countedFree(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept{
+	countedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept{
+	countedFree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept{
+	countedFree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept{
+	countedFree(ptr);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+/// AllocationCounter
+////////////////////////////////////////////////////////////////////////
+
+AllocationCounter::AllocationCounter(){
+	reset();
+}
+
+void AllocationCounter::reset(){
+	startAllocations = allocations;
+	startFrees = frees;
+}
+
+uint64_t AllocationCounter::getAllocations() const{
+	return allocations - startAllocations;
+}
+
+uint64_t AllocationCounter::getFrees() const{
+	return frees - startFrees;
+}
+
+bool AllocationCounter::isEnabled(){
+#ifdef TEAM2655_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,56 @@
+/**
+ * allocationcounter.hpp
+ * Counts heap allocations so code that must not allocate in the control loop (AutoManager::process, jshelper::getAxisValue)
+ * can be checked. Counting replaces the global operator new and delete, so it is only compiled in when
+ * TEAM2655_COUNT_ALLOCATIONS is defined (ex. g++ -DTEAM2655_COUNT_ALLOCATIONS ...). Do not define it for the robot.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace team2655{
+
+/**
+ * Counts the allocations and frees made by the thread that created it (other threads are not counted)
+ * Usage:
+ *     AllocationCounter counter;
+ *     manager.process();
+ *     if(counter.getAllocations() != 0) ...
+ */
+class AllocationCounter{
+private:
+	uint64_t startAllocations;
+	uint64_t startFrees;
+
+public:
+	/**
+	 * Start counting from now
+	 */
+	AllocationCounter();
+
+	/**
+	 * Start counting from zero again
+	 */
+	void reset();
+
+	/**
+	 * Get the number of times this thread called operator new since the counter was created or reset
+	 */
+	uint64_t getAllocations() const;
+
+	/**
+	 * Get the number of times this thread freed memory with operator delete since the counter was created or reset
+	 */
+	uint64_t getFrees() const;
+
+	/**
+	 * Was this built with TEAM2655_COUNT_ALLOCATIONS. If not every count is always zero.
+	 */
+	static bool isEnabled();
+};
+
+}
@@ -7,25 +7,190 @@
  */
 
 #include "autonomous.hpp"
+#include "compiledscript.hpp"
 
+#include <algorithm>
 #include <chrono>
-#include <sstream>
-#include <regex>
 #include <fstream>
 #include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace team2655;
 
 ////////////////////////////////////////////////////////////////////////
-/// AutoCommand
+/// ArgumentSpec
+////////////////////////////////////////////////////////////////////////
+
+ArgumentSpec::ArgumentSpec(std::string name, ArgumentType type, std::vector<std::string> enumValues) :
+		name(name), type(type), enumValues(enumValues){
+
+}
+
+////////////////////////////////////////////////////////////////////////
+/// AutoArgument
 ////////////////////////////////////////////////////////////////////////
 
-long int AutoCommand::currentTimeMillis(){
-	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+// Case insensitive compare of two strings
+static bool equalsIgnoreCase(StringRef a, StringRef b){
+	if(a.length != b.length)
+		return false;
+	for(size_t i = 0; i < a.length; i++){
+		if(std::toupper((unsigned char)a.data[i]) != std::toupper((unsigned char)b.data[i]))
+			return false;
+	}
+	return true;
+}
+
+AutoArgument AutoArgument::fromInt(long int value){
+	AutoArgument arg;
+	arg.type = ArgumentType::Int;
+	arg.intValue = value;
+	return arg;
+}
+
+AutoArgument AutoArgument::fromDouble(double value){
+	AutoArgument arg;
+	arg.type = ArgumentType::Double;
+	arg.doubleValue = value;
+	return arg;
+}
+
+AutoArgument AutoArgument::fromBool(bool value){
+	AutoArgument arg;
+	arg.type = ArgumentType::Bool;
+	arg.intValue = value ? 1 : 0;
+	return arg;
+}
+
+AutoArgument AutoArgument::fromEnum(int index){
+	AutoArgument arg;
+	arg.type = ArgumentType::Enum;
+	arg.intValue = index;
+	return arg;
+}
+
+bool AutoArgument::parse(StringRef text, const ArgumentSpec &spec, AutoArgument &result, std::string &error){
+
+	if(text.empty()){
+		error = "missing value for argument \"" + spec.name + "\"";
+		return false;
+	}
+
+	// strtol and strtod need a null terminated string. Numbers are short so copy to the stack instead of a std::string.
+	char value[64];
+	if((spec.type == ArgumentType::Int || spec.type == ArgumentType::Double) && text.length >= sizeof(value)){
+		error = "value for argument \"" + spec.name + "\" is too long";
+		return false;
+	}
+	size_t copyLength = std::min(text.length, sizeof(value) - 1);
+	std::copy_n(text.data, copyLength, value);
+	value[copyLength] = '\0';
+
+	switch(spec.type){
+	case ArgumentType::Int:
+	{
+		char *end;
+		errno = 0;
+		long int parsed = std::strtol(value, &end, 10);
+		if(*end != '\0' || errno == ERANGE){
+			error = "expected a whole number for argument \"" + spec.name + "\" but got \"" + text.str() + "\"";
+			return false;
+		}
+		result = fromInt(parsed);
+		return true;
+	}
+	case ArgumentType::Double:
+	{
+		char *end;
+		errno = 0;
+		double parsed = std::strtod(value, &end);
+		// strtod also accepts nan, inf and numbers too big for a double (which become inf)
+		if(*end != '\0' || errno == ERANGE || !std::isfinite(parsed)){
+			error = "expected a number for argument \"" + spec.name + "\" but got \"" + text.str() + "\"";
+			return false;
+		}
+		result = fromDouble(parsed);
+		return true;
+	}
+	case ArgumentType::Bool:
+		if(equalsIgnoreCase(text, StringRef("true", 4)) || equalsIgnoreCase(text, StringRef("yes", 3)) || text == StringRef("1", 1)){
+			result = fromBool(true);
+			return true;
+		}else if(equalsIgnoreCase(text, StringRef("false", 5)) || equalsIgnoreCase(text, StringRef("no", 2)) || text == StringRef("0", 1)){
+			result = fromBool(false);
+			return true;
+		}
+		error = "expected true or false for argument \"" + spec.name + "\" but got \"" + text.str() + "\"";
+		return false;
+	case ArgumentType::Enum:
+		for(size_t i = 0; i < spec.enumValues.size(); i++){
+			if(equalsIgnoreCase(text, spec.enumValues[i])){
+				result = fromEnum(i);
+				return true;
+			}
+		}
+		error = "\"" + text.str() + "\" is not a valid value for argument \"" + spec.name + "\"";
+		return false;
+	}
+
+	error = "unknown type for argument \"" + spec.name + "\"";
+	return false;
+}
+
+ArgumentType AutoArgument::getType() const{
+	return type;
+}
+
+long int AutoArgument::getInt() const{
+	return (type == ArgumentType::Double) ? (long int)doubleValue : intValue;
+}
+
+double AutoArgument::getDouble() const{
+	return (type == ArgumentType::Double) ? doubleValue : (double)intValue;
+}
+
+bool AutoArgument::getBool() const{
+	return (type == ArgumentType::Double) ? (doubleValue != 0) : (intValue != 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+/// AutoClock
+////////////////////////////////////////////////////////////////////////
+
+int64_t SteadyAutoClock::nowMicros(){
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t ManualAutoClock::nowMicros(){
+	return now;
 }
 
+void ManualAutoClock::setMicros(int64_t now){
+	this->now = now;
+}
+
+void ManualAutoClock::advanceMicros(int64_t amount){
+	this->now += amount;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// AutoCommand
+////////////////////////////////////////////////////////////////////////
+
 bool AutoCommand::hasTimedOut(){
-	return currentTimeMillis()  - startTime >= timeout;
+	// A negative timeout never times out
+	return timeout >= 0 && tick.now - startTime >= timeout;
 }
 
 bool AutoCommand::hasStarted(){
@@ -37,22 +202,42 @@ bool AutoCommand::isComplete(){
 }
 
 void AutoCommand::setTimeout(int timeoutMs){
-	this->timeout = timeoutMs;
+	this->timeout = (int64_t)timeoutMs * 1000;
+}
+
+void AutoCommand::setTimeoutMicros(int64_t timeoutUs){
+	this->timeout = timeoutUs;
+}
+
+void AutoCommand::setTimeoutSeconds(double timeoutSeconds){
+	// Converting a double that does not fit in an int64_t is undefined, so check the range first (NaN fails both checks)
+	if(timeoutSeconds < 0 || !(timeoutSeconds < 9e12)){
+		this->timeout = -1;
+	}else{
+		this->timeout = (int64_t)(timeoutSeconds * 1000000);
+	}
 }
 
 int AutoCommand::getTimeout(){
+	return this->timeout / 1000;
+}
+
+int64_t AutoCommand::getTimeoutMicros(){
 	return this->timeout;
 }
 
-void AutoCommand::doStart(std::vector<std::string> args){
+void AutoCommand::runStart(const std::vector<AutoArgument> &args, const TickContext &tick){
+	this->tick = tick;
+	// Same size as the arguments given to doPrepare so the storage is reused (no allocation)
 	this->arguments = args;
-	this->startTime = currentTimeMillis();
+	this->startTime = tick.now;
 	this->_hasStarted = true;
 	// Call the start function to be used by custom commands
-	start(args);
+	start(this->arguments);
 }
 
-void AutoCommand::doProcess(){
+void AutoCommand::runProcess(const TickContext &tick){
+	this->tick = tick;
 	// If the command has timed out complete the command
 	if(hasTimedOut())
 		doComplete();
@@ -63,144 +248,1304 @@ void AutoCommand::doProcess(){
 	process();
 }
 
-void AutoCommand::doComplete(){
+void AutoCommand::runComplete(){
 	this->_isComplete = true;
 	// Call the complete function to be used by custom commands
 	complete();
 }
 
+// When profiling is off each of these is a single branch
+
+void AutoCommand::doStart(const std::vector<AutoArgument> &args, const TickContext &tick){
+	if(profile->isEnabled()){
+		uint64_t begin = CommandProfile::nowNanos();
+		runStart(args, tick);
+		profile->start.record(CommandProfile::nowNanos() - begin);
+		profile->addTick();
+	}else{
+		runStart(args, tick);
+	}
+}
+
+void AutoCommand::doProcess(const TickContext &tick){
+	if(profile->isEnabled()){
+		uint64_t begin = CommandProfile::nowNanos();
+		runProcess(tick);
+		profile->process.record(CommandProfile::nowNanos() - begin);
+		profile->addTick();
+	}else{
+		runProcess(tick);
+	}
+}
+
+bool AutoCommand::doPrepare(const std::vector<AutoArgument> &args){
+	this->arguments = args;
+	return prepare(this->arguments);
+}
+
+void AutoCommand::doComplete(){
+	if(profile->isEnabled()){
+		uint64_t begin = CommandProfile::nowNanos();
+		runComplete();
+		profile->complete.record(CommandProfile::nowNanos() - begin);
+	}else{
+		runComplete();
+	}
+}
+
+void AutoCommand::setProfile(CommandProfile *profile){
+	this->profile = (profile == nullptr) ? &CommandProfile::none : profile;
+}
+
+void AutoCommand::doReset(){
+	this->_hasStarted = false;
+	this->_isComplete = false;
+	this->timeout = 0;
+	this->startTime = 0;
+	this->tick = TickContext();
+	// Call the reset function to be used by custom commands
+	reset();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CommandGroup
+////////////////////////////////////////////////////////////////////////
+
+CommandGroup::CommandGroup(Type type) : type(type){
+
+}
+
+void CommandGroup::addCommand(AutoCommand *command, const std::vector<AutoArgument> &args){
+	commands.push_back(command);
+	commandArguments.push_back(args);
+}
+
+CommandGroup::Type CommandGroup::getType() const{
+	return type;
+}
+
+size_t CommandGroup::getCommandCount() const{
+	return commands.size();
+}
+
+std::vector<ArgumentSpec> CommandGroup::getArgumentSpecs(){
+	return {}; // Groups do not take arguments
+}
+
+void CommandGroup::start(const std::vector<AutoArgument> &){
+	// The group is done when its commands are done
+	setTimeout(-1);
+	currentIndex = 0;
+
+	if(commands.size() == 0){
+		doComplete();
+		return;
+	}
+
+	if(type == Type::Sequence){
+		commands[0]->doStart(commandArguments[0], tick);
+		advanceSequence();
+	}else{
+		for(size_t i = 0; i < commands.size(); i++)
+			commands[i]->doStart(commandArguments[i], tick);
+		checkParallel();
+	}
+}
+
+void CommandGroup::process(){
+	if(type == Type::Sequence){
+		if(!commands[currentIndex]->isComplete())
+			commands[currentIndex]->doProcess(tick);
+		advanceSequence();
+		return;
+	}
+
+	// Parallel and race: tick every running command
+	for(AutoCommand *command : commands){
+		if(!command->isComplete())
+			command->doProcess(tick);
+	}
+	checkParallel();
+}
+
+void CommandGroup::advanceSequence(){
+	// Same as the AutoManager: when a command finishes the next one starts on the same tick
+	while(commands[currentIndex]->isComplete()){
+		if(++currentIndex >= commands.size()){
+			doComplete();
+			return;
+		}
+		commands[currentIndex]->doStart(commandArguments[currentIndex], tick);
+	}
+}
+
+void CommandGroup::checkParallel(){
+	size_t completed = 0;
+	for(AutoCommand *command : commands){
+		if(command->isComplete())
+			completed++;
+	}
+
+	if((type == Type::Parallel && completed == commands.size()) || (type == Type::Race && completed > 0))
+		doComplete();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// WaitUntilCommand
+////////////////////////////////////////////////////////////////////////
+
+void WaitUntilCommand::setConditionValues(const std::vector<char> *conditionValues){
+	this->conditionValues = conditionValues;
+}
+
+std::vector<ArgumentSpec> WaitUntilCommand::getArgumentSpecs(){
+	// The names are added by AutoManager::registerCondition
+	return { {"condition", ArgumentType::Enum} };
+}
+
+void WaitUntilCommand::start(const std::vector<AutoArgument> &args){
+	setTimeout(-1);
+	condition = args[0].getInt();
+	// Conditions are evaluated before commands run so this may already be true
+	process();
+}
+
+void WaitUntilCommand::process(){
+	if((*conditionValues)[condition])
+		doComplete();
+}
+
+void WaitUntilCommand::complete(){
+
+}
+
+void CommandGroup::complete(){
+	// Stop anything still running (the group was killed or a race was won)
+	for(AutoCommand *command : commands){
+		if(command->hasStarted() && !command->isComplete())
+			command->doComplete();
+	}
+}
+
+void CommandGroup::reset(){
+	currentIndex = 0;
+	for(AutoCommand *command : commands)
+		command->doReset();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CommandArena
+////////////////////////////////////////////////////////////////////////
+
+const size_t CommandArena::BLOCK_SIZE;
+
+void *CommandArena::allocate(size_t size, size_t align){
+	// Find room in the current block or any later (already allocated) block
+	while(currentBlock < blocks.size()){
+		size_t start = (used + align - 1) / align * align;
+		if(start + size <= blockSizes[currentBlock]){
+			used = start + size;
+			return blocks[currentBlock].get() + start;
+		}
+		currentBlock++;
+		used = 0;
+	}
+
+	// Need a new block. Blocks from new[] are aligned for any fundamental type.
+	size_t blockSize = std::max(BLOCK_SIZE, size);
+	blocks.push_back(std::unique_ptr<char[]>(new char[blockSize]));
+	blockSizes.push_back(blockSize);
+	currentBlock = blocks.size() - 1;
+	used = size;
+	return blocks[currentBlock].get();
+}
+
+AutoCommand *CommandArena::create(CommandFactory factory, size_t size, size_t align){
+	AutoCommand *command = factory(allocate(size, align));
+	objects.push_back(command);
+	return command;
+}
+
+void CommandArena::reserve(size_t bytes, size_t count){
+	objects.reserve(objects.size() + count);
+
+	// allocate moves on to later blocks when one is full, so any block from the current one on with enough room will do
+	for(size_t i = currentBlock; i < blocks.size(); i++){
+		size_t room = blockSizes[i] - ((i == currentBlock) ? used : 0);
+		if(room >= bytes)
+			return;
+	}
+	size_t blockSize = std::max(BLOCK_SIZE, bytes);
+	blocks.push_back(std::unique_ptr<char[]>(new char[blockSize]));
+	blockSizes.push_back(blockSize);
+}
+
+void CommandArena::clear(){
+	// Destroy in reverse order of construction
+	for(auto it = objects.rbegin(); it != objects.rend(); it++)
+		(*it)->~AutoCommand();
+	objects.clear();
+	currentBlock = 0;
+	used = 0;
+}
+
+CommandArena::~CommandArena(){
+	clear();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CaseInsensitiveHash / CaseInsensitiveEqual
+////////////////////////////////////////////////////////////////////////
+
+size_t CaseInsensitiveHash::operator()(const std::string &str) const{
+	// FNV-1a on the upper case characters
+	size_t hash = 2166136261u;
+	for(char c : str){
+		hash ^= (size_t)std::toupper((unsigned char)c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+bool CaseInsensitiveEqual::operator()(const std::string &a, const std::string &b) const{
+	return equalsIgnoreCase(StringRef(a), StringRef(b));
+}
+
 ////////////////////////////////////////////////////////////////////////
 /// AutoManager
 ////////////////////////////////////////////////////////////////////////
 
-std::vector<std::string> AutoManager::split(const std::string& s, char delimiter){
-	std::vector<std::string> tokens;
-	std::string token;
-	std::istringstream tokenStream(s);
-	while (std::getline(tokenStream, token, delimiter)){
-		tokens.push_back(token);
+const size_t AutoManager::INJECT_QUEUE_SIZE;
+
+const int AutoScript::CALL;
+const int AutoScript::RETURN;
+const int AutoScript::REPEAT;
+const int AutoScript::LOOP;
+const long int AutoScript::MAX_REPEAT;
+
+// Ends a group (or DEFINE/REPEAT) in a script
+static const StringRef GROUP_END("END", 3);
+
+// Control flow in scripts
+static const StringRef SCRIPT_DEFINE("DEFINE", 6);
+static const StringRef SCRIPT_CALL("CALL", 4);
+static const StringRef SCRIPT_REPEAT("REPEAT", 6);
+
+// Names that can not be used for commands
+static bool isReservedName(StringRef name){
+	return equalsIgnoreCase(name, GROUP_END) || equalsIgnoreCase(name, SCRIPT_DEFINE) ||
+		   equalsIgnoreCase(name, SCRIPT_CALL) || equalsIgnoreCase(name, SCRIPT_REPEAT);
+}
+
+// Used by any AutoManager without its own clock
+static SteadyAutoClock defaultClock;
+
+AutoManager::AutoManager() : script(std::make_shared<AutoScript>()), clock(&defaultClock), processingThread(std::thread::id()){
+	registerCommand<SequenceGroup>("SEQUENCE");
+	registerCommand<ParallelGroup>("PARALLEL");
+	registerCommand<RaceGroup>("RACE");
+	registerCommand<WaitUntilCommand>("WAIT_UNTIL");
+	waitUntilId = findCommand("WAIT_UNTIL");
+	insertObjects.reserve(INJECT_QUEUE_SIZE);
+}
+
+void AutoManager::setClock(AutoClock *clock){
+	this->clock = (clock == nullptr) ? &defaultClock : clock;
+}
+
+const TickContext &AutoManager::getTick() const{
+	return tick;
+}
+
+void AutoManager::resetTicks(){
+	tick = TickContext();
+	tickCount = 0;
+	// Edges are only seen between ticks of the same run
+	for(Condition &condition : conditions)
+		condition.hasLast = false;
+	std::fill(conditionValues.begin(), conditionValues.end(), 0);
+}
+
+bool AutoManager::registerCondition(const std::string &name, ConditionSource source, ConditionType type, double threshold){
+	if(source == nullptr){
+		std::cerr << "AutoManagerError: registerCondition: no source given for \"" << name << "\"" << std::endl;
+		return false;
+	}
+	std::vector<std::string> &names = registeredCommands[waitUntilId].argumentSpecs[0].enumValues;
+	for(const std::string &existing : names){
+		if(equalsIgnoreCase(StringRef(existing), StringRef(name))){
+			std::cerr << "AutoManagerError: registerCondition: \"" << name << "\" is already registered" << std::endl;
+			return false;
+		}
+	}
+
+	// The names are WAIT_UNTIL's argument values so scripts are checked against them when they are loaded
+	names.push_back(name);
+	conditions.push_back({ source, type, threshold, 0, false });
+	conditionValues.push_back(0);
+	return true;
+}
+
+bool AutoManager::getCondition(const std::string &name) const{
+	const std::vector<std::string> &names = registeredCommands[waitUntilId].argumentSpecs[0].enumValues;
+	for(size_t i = 0; i < names.size(); i++){
+		if(equalsIgnoreCase(StringRef(names[i]), StringRef(name)))
+			return conditionValues[i] != 0;
 	}
-	return tokens;
+	return false;
 }
 
-bool AutoManager::loadScript(std::string scriptName){
+void AutoManager::evaluateConditions(){
+	// One pass over every condition. Each source is read once per tick no matter how many commands wait on it.
+	for(size_t i = 0; i < conditions.size(); i++){
+		Condition &condition = conditions[i];
+		double value = condition.source();
+		bool above = value >= condition.threshold;
+		bool wasAbove = condition.hasLast && condition.last >= condition.threshold;
+		bool result = false;
+		switch(condition.type){
+		case ConditionType::AtLeast:
+			result = above;
+			break;
+		case ConditionType::AtMost:
+			result = value <= condition.threshold;
+			break;
+		case ConditionType::Rising:
+			result = condition.hasLast && !wasAbove && above;
+			break;
+		case ConditionType::Falling:
+			result = condition.hasLast && wasAbove && !above;
+			break;
+		}
+		conditionValues[i] = result;
+		condition.last = value;
+		condition.hasLast = true;
+	}
+}
 
-	clearCommands();
+bool AutoManager::registerCommand(const std::string &name, CommandFactory factory, size_t size, size_t align){
+	if(factory == nullptr){
+		std::cerr << "AutoManagerError: registerCommand: no factory given for \"" << name << "\"" << std::endl;
+		return false;
+	}
+	if(isReservedName(StringRef(name))){
+		std::cerr << "AutoManagerError: registerCommand: \"" << name << "\" is reserved" << std::endl;
+		return false;
+	}
+	if(commandIds.find(name) != commandIds.end()){
+		std::cerr << "AutoManagerError: registerCommand: \"" << name << "\" is already registered" << std::endl;
+		return false;
+	}
+
+	if(align > alignof(std::max_align_t)){
+		std::cerr << "AutoManagerError: registerCommand: \"" << name << "\" is over aligned" << std::endl;
+		return false;
+	}
 
-	std::ifstream scriptFile;
-	scriptFile.open(this->getScriptDir() + "/" + scriptName);
+	// Get the schema once now instead of every time the command is used
+	RegisteredCommand registered;
+	registered.name = name;
+	registered.factory = factory;
+	registered.size = size;
+	registered.align = align;
+	std::unique_ptr<char[]> memory(new char[size]);
+	AutoCommand *command = factory(memory.get());
+	registered.argumentSpecs = command->getArgumentSpecs();
+	command->~AutoCommand();
 
-	if(!scriptFile.good()){
-		std::cerr << "Script file: \"" << scriptName << "\" not found in \"" << this->getScriptDir() << "\"" << std::endl;
-		scriptFile.close();
-		return false; // Some error accessing the file
+	commandIds[name] = registeredCommands.size();
+	registeredCommands.push_back(registered);
+	profiles.push_back(std::unique_ptr<CommandProfile>(new CommandProfile()));
+	profiles.back()->setEnabled(profiling);
+	return true;
+}
+
+void AutoManager::setProfilingEnabled(bool enabled){
+	profiling = enabled;
+	for(auto &profile : profiles)
+		profile->setEnabled(enabled);
+}
+
+bool AutoManager::isProfilingEnabled() const{
+	return profiling;
+}
+
+const CommandProfile *AutoManager::getProfile(const std::string &commandName) const{
+	int id = findCommand(commandName);
+	return (id == -1) ? nullptr : profiles[id].get();
+}
+
+void AutoManager::resetProfiles(){
+	for(auto &profile : profiles)
+		profile->reset();
+}
+
+bool AutoManager::writeProfileCSV(const std::string &path) const{
+	std::ofstream file(path, std::ios::trunc);
+	if(!file.good()){
+		std::cerr << "AutoManagerError: writeProfileCSV: could not open \"" << path << "\"" << std::endl;
+		return false;
 	}
 
-	// Get the file contents
-	std::stringstream fileContents;
-	fileContents << scriptFile.rdbuf();
-	scriptFile.close();
+	// Times in microseconds
+	file << "command,ticks,phase,calls,min_us,mean_us,p50_us,p99_us,max_us\n";
+	for(size_t i = 0; i < registeredCommands.size(); i++){
+		const CommandProfile &profile = *profiles[i];
+		const DurationHistogram *phases[] = { &profile.start, &profile.process, &profile.complete };
+		const char *phaseNames[] = { "start", "process", "complete" };
+		for(int j = 0; j < 3; j++){
+			const DurationHistogram &h = *phases[j];
+			if(h.getCount() == 0)
+				continue;
+			file << registeredCommands[i].name << "," << profile.getTicks() << "," << phaseNames[j] << "," << h.getCount() << ","
+				 << h.getMin() / 1000.0 << "," << h.getMean() / 1000.0 << "," << h.getPercentile(50) / 1000.0 << ","
+				 << h.getPercentile(99) / 1000.0 << "," << h.getMax() / 1000.0 << "\n";
+		}
+	}
+	return file.good();
+}
 
-	// Remove spaces after commas
-	std::string csvData = std::regex_replace(fileContents.str(), std::regex(",\\s+"), ",");
+int AutoManager::findCommand(const std::string &name) const{
+	auto it = commandIds.find(name);
+	return (it == commandIds.end()) ? -1 : it->second;
+}
 
-	// Standardize line endings convert any line ending int '\n'
-	csvData = std::regex_replace(csvData, std::regex("(\r\n|\r|\n)"), "\n");
+AutoCommand *AutoManager::createCommand(int commandId, CommandArena &arena) const{
+	const RegisteredCommand &registered = registeredCommands[commandId];
+	AutoCommand *command = arena.create(registered.factory, registered.size, registered.align);
+	command->setProfile(profiles[commandId].get());
+	if(commandId == waitUntilId)
+		static_cast<WaitUntilCommand*>(command)->setConditionValues(&conditionValues);
+	return command;
+}
 
-	std::vector<std::string> lines = split(csvData, '\n'); // Separate each line
+bool AutoManager::parseArguments(int commandId, const StringRef *arguments, size_t argumentCount,
+		                         std::vector<AutoArgument> &result, std::string &error) const{
+	const std::string &command = registeredCommands[commandId].name;
+	const std::vector<ArgumentSpec> &specs = registeredCommands[commandId].argumentSpecs;
 
-	// Separate each column of the CSV
-	for(size_t i = 0; i < lines.size(); i++){
-		std::vector<std::string> columns = split(lines[i], ','); // All the columns in the CSV
-		loadedCommands.push_back(columns[0]); // This is the command
-		columns.erase(columns.begin()); // Remove the command from the list of columns. This will leave only arguments
-		loadedArguments.push_back(columns);
+	if(argumentCount < specs.size()){
+		error = "column " + std::to_string(argumentCount + 2) + ": " + command + " expects " +
+				std::to_string(specs.size()) + " argument(s) but only " + std::to_string(argumentCount) + " given";
+		return false;
 	}
 
-	// Reset
-	currentCommandIndex = -1;
-	currentCommand.release();
+	// Any extra columns are ignored (comments)
+	result.clear();
+	result.reserve(specs.size());
+	for(size_t i = 0; i < specs.size(); i++){
+		AutoArgument arg;
+		std::string argError;
+		if(!AutoArgument::parse(arguments[i], specs[i], arg, argError)){
+			error = "column " + std::to_string(i + 2) + ": " + argError; // Column 1 is the command
+			return false;
+		}
+		result.push_back(arg);
+	}
+	return true;
+}
+
+// Read a whole file into a string
+static bool readFile(const std::string &path, std::string &contents){
+	std::ifstream file(path, std::ios::binary);
+	if(!file.good())
+		return false;
+	file.seekg(0, std::ios::end);
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+	contents.assign(fileSize > 0 ? (size_t)fileSize : 0, '\0');
+	file.read(&contents[0], contents.size());
+	return true;
+}
+
+// Check the (case insensitive) extension of a file name
+static bool hasExtension(const std::string &name, const char *extension){
+	size_t length = std::strlen(extension);
+	return name.size() > length && equalsIgnoreCase(StringRef(name.data() + name.size() - length, length), StringRef(extension, length));
+}
+
+// Scripts are any file ending in .csv or .auto (compiled)
+static bool isScriptFile(const std::string &name){
+	return hasExtension(name, ".csv") || hasExtension(name, ".auto");
+}
+
+bool AutoManager::parseScriptLines(const std::string &scriptName, const std::string &scriptText,
+		                           std::vector<std::string> &strings, std::vector<compiledscript::ScriptLine> &lines) const{
+	CSVTokenizer tokenizer(scriptText.data(), scriptText.size());
+	std::vector<StringRef> columns; // Reused for every line
+	std::vector<int> stringIndex(registeredCommands.size(), -1); // Command id to index in strings
+	std::unordered_map<std::string, int, CaseInsensitiveHash, CaseInsensitiveEqual> subroutines; // Name to number
+
+	while(tokenizer.nextLine(columns)){
+		compiledscript::ScriptLine line;
+		line.line = tokenizer.getLineNumber();
+
+		// END closes the innermost group, DEFINE, or REPEAT. Nesting is checked by buildScript.
+		if(equalsIgnoreCase(columns[0], GROUP_END)){
+			line.name = compiledscript::END_RECORD;
+			lines.push_back(line);
+			continue;
+		}
+
+		// Subroutines are numbered in the order they are defined so compiled scripts do not need their names
+		bool define = equalsIgnoreCase(columns[0], SCRIPT_DEFINE);
+		if(define || equalsIgnoreCase(columns[0], SCRIPT_CALL)){
+			if(columns.size() < 2 || columns[1].empty()){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 2: "
+						  << columns[0].str() << " expects a subroutine name" << std::endl;
+				return false;
+			}
+			std::string name = columns[1].str();
+			auto it = subroutines.find(name);
+			if(define){
+				if(it != subroutines.end()){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 2: subroutine \""
+							  << name << "\" is already defined" << std::endl;
+					return false;
+				}
+				int number = subroutines.size() + 1;
+				subroutines[name] = number;
+				line.name = compiledscript::DEFINE_RECORD;
+				line.arguments.push_back(AutoArgument::fromInt(number));
+			}else{
+				if(it == subroutines.end()){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 2: subroutine \""
+							  << name << "\" is not defined (define subroutines before calling them)" << std::endl;
+					return false;
+				}
+				line.name = compiledscript::CALL_RECORD;
+				line.arguments.push_back(AutoArgument::fromInt(it->second));
+			}
+			lines.push_back(line);
+			continue;
+		}
+
+		if(equalsIgnoreCase(columns[0], SCRIPT_REPEAT)){
+			AutoArgument count;
+			std::string error;
+			if(columns.size() < 2)
+				error = "REPEAT expects a count";
+			else if(AutoArgument::parse(columns[1], ArgumentSpec("count", ArgumentType::Int), count, error) && count.getInt() < 0)
+				error = "REPEAT count can not be negative";
+			else if(error.empty() && count.getInt() > AutoScript::MAX_REPEAT)
+				error = "REPEAT count can not be more than " + std::to_string(AutoScript::MAX_REPEAT);
+			if(!error.empty()){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 2: " << error << std::endl;
+				return false;
+			}
+			line.name = compiledscript::REPEAT_RECORD;
+			line.arguments.push_back(count);
+			lines.push_back(line);
+			continue;
+		}
+
+		// The first column is the command. The rest of the columns are arguments.
+		int command = findCommand(columns[0].str());
+		if(command == -1){
+			std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 1: unknown command \""
+					  << columns[0].str() << "\"" << std::endl;
+			return false;
+		}
+
+		// Parse the arguments now so commands never have to parse text while running
+		std::string error;
+		if(!parseArguments(command, columns.data() + 1, columns.size() - 1, line.arguments, error)){
+			std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": " << error << std::endl;
+			return false;
+		}
+
+		if(stringIndex[command] == -1){
+			stringIndex[command] = strings.size();
+			strings.push_back(registeredCommands[command].name);
+		}
+		line.name = stringIndex[command];
+		lines.push_back(line);
+	}
 
 	return true;
 }
 
-void AutoManager::addCommand(std::string command, std::vector<std::string> arguments, int pos){
+bool AutoManager::buildScript(const std::string &scriptName, const std::vector<std::string> &strings,
+		                      const std::vector<compiledscript::ScriptLine> &lines, AutoScript &result) const{
+	result.name = scriptName;
+
+	// Resolve each name once
+	std::vector<int> commandIds(strings.size());
+	for(size_t i = 0; i < strings.size(); i++){
+		commandIds[i] = findCommand(strings[i]);
+		if(commandIds[i] == -1){
+			std::cerr << "AutoManagerError: " << scriptName << ": unknown command \"" << strings[i] << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	// The steps of the main script (block 0) and each subroutine (block n for DEFINE n). Joined into result at the end.
+	// Until then CALL operands are subroutine numbers and REPEAT operands are indices in their block.
+	struct Block{
+		std::vector<int> commands;
+		std::vector<std::vector<AutoArgument>> arguments;
+		std::vector<AutoCommand*> objects;
+		size_t depth = 0;      // Most frames this block uses (including the subroutines it calls)
+		bool defined = false;  // Has the END of its DEFINE been reached
+		bool runsCommands = false; // Does calling it run at least one command
+	};
+	std::vector<Block> blocks(1);
+	size_t current = 0;  // The block steps are added to
+	size_t repeats = 0;  // REPEATs open in the current block
+
+	// Groups, DEFINEs, and REPEATs that have not been ended yet (innermost last)
+	struct OpenLine{
+		CommandGroup *group;  // nullptr for DEFINE and REPEAT
+		uint32_t record;      // DEFINE_RECORD or REPEAT_RECORD if not a group
+		size_t repeatIndex;   // Where the REPEAT step is in its block
+		uint32_t line;
+		bool runsCommands;    // Does a DEFINE or REPEAT have a step that runs a command
+	};
+	std::vector<OpenLine> open;
+
+	auto addStep = [&](int command, const std::vector<AutoArgument> &arguments, AutoCommand *object){
+		blocks[current].commands.push_back(command);
+		blocks[current].arguments.push_back(arguments);
+		blocks[current].objects.push_back(object);
+		if(command >= 0 && !open.empty())
+			open.back().runsCommands = true;
+	};
+
+	for(const compiledscript::ScriptLine &line : lines){
+		if(line.name == compiledscript::END_RECORD){
+			if(open.empty()){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 1: END without a group, DEFINE, or REPEAT" << std::endl;
+				return false;
+			}
+			OpenLine ended = open.back();
+			open.pop_back();
+			if(ended.group == nullptr && ended.record == compiledscript::REPEAT_RECORD){
+				// A loop that runs no commands would go around count times in a single tick
+				if(!ended.runsCommands){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << ended.line << ": REPEAT has no commands to run" << std::endl;
+					return false;
+				}
+				if(blocks[current].arguments[ended.repeatIndex][0].getInt() > 0 && !open.empty())
+					open.back().runsCommands = true;
+				blocks[current].arguments[ended.repeatIndex][1] = AutoArgument::fromInt(blocks[current].commands.size());
+				addStep(AutoScript::LOOP, {}, nullptr);
+				repeats--;
+			}else if(ended.group != nullptr){
+				// An empty group completes as soon as it starts. In a loop that is a loop with nothing to run.
+				if(ended.group->getCommandCount() == 0){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << ended.line << ": group has no commands to run" << std::endl;
+					return false;
+				}
+			}else{
+				addStep(AutoScript::RETURN, {}, nullptr);
+				blocks[current].defined = true;
+				blocks[current].runsCommands = ended.runsCommands;
+				current = 0;
+			}
+			continue;
+		}
+
+		if(compiledscript::isControlRecord(line.name)){
+			const char *name = (line.name == compiledscript::DEFINE_RECORD) ? "DEFINE" :
+							   (line.name == compiledscript::CALL_RECORD) ? "CALL" : "REPEAT";
+			if(!open.empty() && open.back().group != nullptr){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 1: " << name << " can not be used inside a group" << std::endl;
+				return false;
+			}
+			if(line.arguments.size() != 1 || line.arguments[0].getType() != ArgumentType::Int){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": " << name << " has invalid arguments" << std::endl;
+				return false;
+			}
+			long int operand = line.arguments[0].getInt();
+
+			if(line.name == compiledscript::DEFINE_RECORD){
+				if(!open.empty()){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column 1: DEFINE must be at the top level" << std::endl;
+					return false;
+				}
+				if(operand != (long int)blocks.size()){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": subroutine numbers are out of order" << std::endl;
+					return false;
+				}
+				current = blocks.size();
+				blocks.emplace_back();
+				open.push_back({ nullptr, line.name, 0, line.line, false });
+			}else if(line.name == compiledscript::CALL_RECORD){
+				if(operand <= 0 || operand >= (long int)blocks.size() || !blocks[operand].defined){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": CALL to a subroutine that is not defined yet (subroutines can not call themselves)" << std::endl;
+					return false;
+				}
+				blocks[current].depth = std::max(blocks[current].depth, repeats + 1 + blocks[operand].depth);
+				addStep(AutoScript::CALL, line.arguments, nullptr);
+				if(blocks[operand].runsCommands && !open.empty())
+					open.back().runsCommands = true;
+			}else{
+				if(operand < 0 || operand > AutoScript::MAX_REPEAT){
+					std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": REPEAT count must be from 0 to "
+							  << AutoScript::MAX_REPEAT << std::endl;
+					return false;
+				}
+				open.push_back({ nullptr, line.name, blocks[current].commands.size(), line.line, false });
+				repeats++;
+				blocks[current].depth = std::max(blocks[current].depth, repeats);
+				addStep(AutoScript::REPEAT, { line.arguments[0], AutoArgument::fromInt(0) }, nullptr); // LOOP index set at END
+			}
+			continue;
+		}
 
-	// Any position beyond the end of the vector is converted to -1 (aka the end)
-	if((pos > ((int)loadedCommands.size())) || pos < -1)
-		pos = -1;
+		// Compiled scripts may be older than the code. Make sure the arguments still match.
+		int command = commandIds[line.name];
+		const std::vector<ArgumentSpec> &specs = registeredCommands[command].argumentSpecs;
+		if(line.arguments.size() != specs.size()){
+			std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": " << registeredCommands[command].name
+					  << " expects " << specs.size() << " argument(s) but has " << line.arguments.size() << std::endl;
+			return false;
+		}
+		for(size_t i = 0; i < specs.size(); i++){
+			if(line.arguments[i].getType() != specs[i].type){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column " << (i + 2)
+						  << ": wrong type for argument \"" << specs[i].name << "\"" << std::endl;
+				return false;
+			}
+			// Enums are stored by index. The code may now have fewer values (ex. a condition was removed).
+			if(specs[i].type == ArgumentType::Enum &&
+					(line.arguments[i].getInt() < 0 || line.arguments[i].getInt() >= (long int)specs[i].enumValues.size())){
+				std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": column " << (i + 2)
+						  << ": value " << line.arguments[i].getInt() << " of argument \"" << specs[i].name << "\" is out of range (there are "
+						  << specs[i].enumValues.size() << " values). Recompile the script." << std::endl;
+				return false;
+			}
+		}
+
+		AutoCommand *object = createCommand(command, result.arena);
+		if(!object->doPrepare(line.arguments)){
+			std::cerr << "AutoManagerError: " << scriptName << ":" << line.line << ": " << registeredCommands[command].name
+					  << " could not be prepared with these arguments" << std::endl;
+			return false;
+		}
+		if(open.empty() || open.back().group == nullptr){
+			addStep(command, line.arguments, object);
+		}else{
+			open.back().group->addCommand(object, line.arguments);
+		}
+
+		CommandGroup *group = dynamic_cast<CommandGroup*>(object);
+		if(group != nullptr)
+			open.push_back({ group, 0, 0, line.line, false });
+	}
+
+	if(!open.empty()){
+		const char *name = (open.back().group != nullptr) ? "group" :
+						   (open.back().record == compiledscript::DEFINE_RECORD) ? "DEFINE" : "REPEAT";
+		std::cerr << "AutoManagerError: " << scriptName << ":" << open.back().line << ": " << name << " is missing END" << std::endl;
+		return false;
+	}
+
+	// Main script first then each subroutine once
+	std::vector<size_t> starts(blocks.size());
+	for(size_t i = 1; i < blocks.size(); i++)
+		starts[i] = starts[i - 1] + blocks[i - 1].commands.size();
+
+	result.mainLength = blocks[0].commands.size();
+	result.maxDepth = blocks[0].depth;
+	for(size_t i = 0; i < blocks.size(); i++){
+		Block &block = blocks[i];
+		for(size_t j = 0; j < block.commands.size(); j++){
+			std::vector<AutoArgument> &operands = block.arguments[j];
+			if(block.commands[j] == AutoScript::CALL)
+				operands[0] = AutoArgument::fromInt(starts[operands[0].getInt()]);
+			else if(block.commands[j] == AutoScript::REPEAT)
+				operands[1] = AutoArgument::fromInt(starts[i] + operands[1].getInt());
+		}
+		result.commands.insert(result.commands.end(), block.commands.begin(), block.commands.end());
+		result.arguments.insert(result.arguments.end(), block.arguments.begin(), block.arguments.end());
+		result.objects.insert(result.objects.end(), block.objects.begin(), block.objects.end());
+	}
 
-	// Add to the end otherwise insert at a position
-	if(pos == -1){
-		loadedCommands.push_back(command);
-		loadedArguments.push_back(arguments);
+	return true;
+}
+
+std::shared_ptr<AutoScript> AutoManager::cacheScript(const std::string &scriptDir, const std::string &scriptName){
+	std::string path = scriptDir + "/" + scriptName;
+	std::vector<std::string> strings;
+	std::vector<compiledscript::ScriptLine> lines;
+
+	if(hasExtension(scriptName, ".auto")){
+		// Compiled script. Already parsed and validated.
+		std::string error;
+		if(!compiledscript::read(path, strings, lines, error)){
+			std::cerr << "AutoManagerError: " << scriptName << ": " << error << std::endl;
+			return nullptr;
+		}
 	}else{
-		loadedCommands.insert(loadedCommands.begin() + pos, command);
-		loadedArguments.insert(loadedArguments.begin() + pos, arguments);
+		std::string scriptText;
+		if(!readFile(path, scriptText)){
+			std::cerr << "Script file: \"" << scriptName << "\" not found in \"" << scriptDir << "\"" << std::endl;
+			return nullptr; // Some error accessing the file
+		}
+		if(!parseScriptLines(scriptName, scriptText, strings, lines))
+			return nullptr;
+	}
+
+	std::shared_ptr<AutoScript> parsed = std::make_shared<AutoScript>();
+	if(!buildScript(scriptName, strings, lines, *parsed))
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(scriptCacheMutex);
+	scriptCache[scriptName] = parsed;
+	return parsed;
+}
+
+bool AutoManager::compileScript(const std::string &inputPath, const std::string &outputPath){
+	std::string scriptText;
+	if(!readFile(inputPath, scriptText)){
+		std::cerr << "AutoManagerError: compileScript: could not read \"" << inputPath << "\"" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> strings;
+	std::vector<compiledscript::ScriptLine> lines;
+	if(!parseScriptLines(inputPath, scriptText, strings, lines))
+		return false;
+
+	// Build it once to check the groups
+	AutoScript check;
+	if(!buildScript(inputPath, strings, lines, check))
+		return false;
+
+	std::string error;
+	if(!compiledscript::write(outputPath, strings, lines, error)){
+		std::cerr << "AutoManagerError: compileScript: " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool AutoManager::preloadScripts(){
+	std::string scriptDir = getScriptDir();
+	DIR *dir = opendir(scriptDir.c_str());
+	if(dir == nullptr){
+		std::cerr << "AutoManagerError: preloadScripts: could not open \"" << scriptDir << "\"" << std::endl;
+		return false;
+	}
+
+	struct dirent *entry;
+	while((entry = readdir(dir)) != nullptr){
+		std::string name = entry->d_name;
+		struct stat info;
+		if(!isScriptFile(name) || stat((scriptDir + "/" + name).c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+			continue;
+		cacheScript(scriptDir, name); // Errors are reported by cacheScript
+	}
+	closedir(dir);
+	return true;
+}
+
+bool AutoManager::selectScript(const std::string &scriptName){
+	std::shared_ptr<AutoScript> selected;
+	{
+		std::lock_guard<std::mutex> lock(scriptCacheMutex);
+		auto it = scriptCache.find(scriptName);
+		if(it == scriptCache.end())
+			return false;
+		selected = it->second;
+	}
+
+	// Stop whatever was running before switching
+	killAuto();
+	useScript(selected);
+	restart();
+	return true;
+}
+
+bool AutoManager::startWatching(){
+	if(watching)
+		return true;
+
+	std::string scriptDir = getScriptDir();
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd < 0){
+		std::cerr << "AutoManagerError: startWatching: inotify is not available" << std::endl;
+		return false;
+	}
+	if(inotify_add_watch(fd, scriptDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0){
+		std::cerr << "AutoManagerError: startWatching: could not watch \"" << scriptDir << "\"" << std::endl;
+		close(fd);
+		return false;
+	}
+
+	watching = true;
+	watchThread = std::thread(&AutoManager::watchScripts, this, fd, scriptDir);
+	return true;
+}
+
+void AutoManager::stopWatching(){
+	watching = false;
+	if(watchThread.joinable())
+		watchThread.join();
+}
+
+void AutoManager::watchScripts(int inotifyFd, std::string scriptDir){
+	alignas(struct inotify_event) char buffer[4096];
+
+	while(watching){
+		// Wake up periodically to check if the watcher should stop
+		struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+		if(poll(&pfd, 1, 250) <= 0)
+			continue;
+
+		ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+		for(ssize_t pos = 0; pos < length; ){
+			const struct inotify_event *event = (const struct inotify_event*)(buffer + pos);
+			pos += sizeof(struct inotify_event) + event->len;
+
+			if(event->len == 0)
+				continue;
+			std::string name = event->name;
+			if(!isScriptFile(name))
+				continue;
+
+			if(event->mask & (IN_DELETE | IN_MOVED_FROM)){
+				std::lock_guard<std::mutex> lock(scriptCacheMutex);
+				scriptCache.erase(name);
+			}else{
+				// If the new version is invalid the old one stays in the cache
+				cacheScript(scriptDir, name);
+			}
+		}
 	}
 
+	close(inotifyFd);
 }
 
-void AutoManager::addCommands(std::vector<std::string> commands, std::vector<std::vector<std::string>> arguments, int pos){
+bool AutoManager::loadScript(std::string scriptName){
+
+	clearCommands();
+
+	std::shared_ptr<AutoScript> loaded = cacheScript(this->getScriptDir(), scriptName);
+	if(loaded == nullptr)
+		return false;
+
+	useScript(loaded);
+	restart();
+	return true;
+}
+
+bool AutoManager::addCommand(std::string command, std::vector<std::string> arguments, int pos){
+
+	int commandId = findCommand(command);
+	if(commandId == -1){
+		std::cerr << "AutoManagerError: addCommand: unknown command \"" << command << "\"" << std::endl;
+		return false;
+	}
+
+	std::vector<StringRef> argumentRefs(arguments.begin(), arguments.end());
+	std::vector<AutoArgument> parsedArguments;
+	std::string error;
+	if(!parseArguments(commandId, argumentRefs.data(), argumentRefs.size(), parsedArguments, error)){
+		std::cerr << "AutoManagerError: addCommand: " << error << std::endl;
+		return false;
+	}
+
+	std::vector<std::vector<AutoArgument>> commandArguments = { parsedArguments };
+	return insertCommands(pos, { commandId }, commandArguments);
+}
+
+bool AutoManager::addCommands(std::vector<std::string> commands, std::vector<std::vector<std::string>> arguments, int pos){
 
 	if(commands.size() != arguments.size()){
 		std::cerr << "AutoManagerError: addCommands: must have same number of commands and arguments" << std::endl;
-		return;
+		return false;
+	}
+
+	// Validate everything before adding anything
+	std::vector<int> ids(commands.size());
+	std::vector<std::vector<AutoArgument>> parsedArguments(commands.size());
+	for(size_t i = 0; i < commands.size(); i++){
+		ids[i] = findCommand(commands[i]);
+		if(ids[i] == -1){
+			std::cerr << "AutoManagerError: addCommands: command " << i << ": unknown command \"" << commands[i] << "\"" << std::endl;
+			return false;
+		}
+		std::vector<StringRef> argumentRefs(arguments[i].begin(), arguments[i].end());
+		std::string error;
+		if(!parseArguments(ids[i], argumentRefs.data(), argumentRefs.size(), parsedArguments[i], error)){
+			std::cerr << "AutoManagerError: addCommands: command " << i << ": " << error << std::endl;
+			return false;
+		}
+	}
+
+	return insertCommands(pos, ids, parsedArguments);
+}
+
+bool AutoManager::injectCommand(const std::string &command, const std::vector<std::string> &arguments, int pos){
+	// Registered commands do not change after construction so checking here is safe from any thread
+	InjectedCommand injected;
+	injected.commandId = findCommand(command);
+	if(injected.commandId == -1){
+		std::cerr << "AutoManagerError: injectCommand: unknown command \"" << command << "\"" << std::endl;
+		return false;
+	}
+
+	std::vector<StringRef> argumentRefs(arguments.begin(), arguments.end());
+	std::string error;
+	if(!parseArguments(injected.commandId, argumentRefs.data(), argumentRefs.size(), injected.arguments, error)){
+		std::cerr << "AutoManagerError: injectCommand: " << error << std::endl;
+		return false;
+	}
+
+	injected.pos = pos;
+	if(!injectedCommands.push(std::move(injected))){
+		injectOverflows.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+uint64_t AutoManager::getInjectOverflowCount() const{
+	return injectOverflows.load(std::memory_order_relaxed);
+}
+
+void AutoManager::discardInjectedCommands(){
+	InjectedCommand dropped;
+	while(injectedCommands.pop(dropped)){ }
+}
+
+void AutoManager::useScript(const std::shared_ptr<AutoScript> &cached){
+	discardInjectedCommands();
+	std::shared_ptr<AutoScript> run = std::make_shared<AutoScript>();
+	if(cached != nullptr){
+		run->name = cached->name;
+		run->commands = cached->commands;
+		run->arguments = cached->arguments;
+		run->objects = cached->objects;
+		run->mainLength = cached->mainLength;
+		run->maxDepth = cached->maxDepth;
+		run->source = cached;
+	}
+
+	// Room for a full queue of injected commands of any type so process does not allocate to add them
+	size_t largest = 0;
+	for(const RegisteredCommand &registered : registeredCommands)
+		largest = std::max(largest, registered.size + registered.align - 1);
+	run->commands.reserve(run->commands.size() + INJECT_QUEUE_SIZE);
+	run->arguments.reserve(run->arguments.size() + INJECT_QUEUE_SIZE);
+	run->objects.reserve(run->objects.size() + INJECT_QUEUE_SIZE);
+	run->arena.reserve(largest * INJECT_QUEUE_SIZE, INJECT_QUEUE_SIZE);
+	script = run;
+}
+
+bool AutoManager::insertCommands(int pos, const std::vector<int> &ids, std::vector<std::vector<AutoArgument>> &arguments){
+	// Any position beyond the end of the main script is converted to -1 (aka the end of it). Subroutines stay after it.
+	if(pos > ((int)script->mainLength) || pos < 0)
+		pos = script->mainLength;
+	long int count = ids.size();
+	bool finished = currentCommandIndex >= ((int)script->mainLength) && frames.empty();
+
+	insertObjects.clear();
+	for(size_t i = 0; i < ids.size(); i++){
+		insertObjects.push_back(createCommand(ids[i], script->arena));
+		if(!insertObjects.back()->doPrepare(arguments[i])){
+			std::cerr << "AutoManagerError: " << registeredCommands[ids[i]].name << " could not be prepared with these arguments" << std::endl;
+			return false;
+		}
+	}
+
+	// Everything from pos on moves. Fix the steps that point at them.
+	for(size_t i = 0; i < script->commands.size(); i++){
+		std::vector<AutoArgument> &operands = script->arguments[i];
+		if(script->commands[i] == AutoScript::CALL && operands[0].getInt() >= pos)
+			operands[0] = AutoArgument::fromInt(operands[0].getInt() + count);
+		else if(script->commands[i] == AutoScript::REPEAT && operands[1].getInt() >= pos)
+			operands[1] = AutoArgument::fromInt(operands[1].getInt() + count);
 	}
 
-	// Any position beyond the end of the vector is converted to -1 (aka the end)
-	if(pos > ((int)loadedCommands.size()) || pos < -1)
-		pos = -1;
+	script->commands.insert(script->commands.begin() + pos, ids.begin(), ids.end());
+	// Insert empty lists and swap the arguments in. Nothing is copied (the script's capacity was reserved by useScript).
+	script->arguments.insert(script->arguments.begin() + pos, count, std::vector<AutoArgument>());
+	for(long int i = 0; i < count; i++)
+		script->arguments[pos + i].swap(arguments[i]);
+	script->objects.insert(script->objects.begin() + pos, insertObjects.begin(), insertObjects.end());
+	script->mainLength += count;
 
-	loadedCommands.insert((pos == -1) ? loadedCommands.end() : loadedCommands.begin() + pos,
-			              commands.begin(),
-						  commands.end());
-	loadedArguments.insert((pos == -1) ? loadedArguments.end() : loadedArguments.begin() + pos,
-						   arguments.begin(),
-						   arguments.end());
+	// Keep running the same command. A finished script stays finished.
+	if(finished)
+		currentCommandIndex = script->mainLength;
+	else if(currentCommandIndex >= pos)
+		currentCommandIndex += count;
+	for(ScriptFrame &frame : frames){
+		// A command inserted where a CALL returns to or a REPEAT starts runs next time
+		if(frame.index > pos)
+			frame.index += count;
+	}
+	return true;
 }
 
 bool AutoManager::hasCommands(){
 	// If there is at least one command and each command has a list of arguments
-	return (loadedCommands.size() > 0) && (loadedArguments.size() == loadedCommands.size());
+	return (script->commands.size() > 0) && (script->arguments.size() == script->commands.size());
 }
 
 bool AutoManager::process(){
+	if(killRequested.load(std::memory_order_acquire)){
+		killAuto();
+		return false;
+	}
+
+	// Add anything other threads injected since the last tick
+	// They go in the copy of the script being run (room for them was reserved when it was selected)
+	InjectedCommand injected;
+	while(injectedCommands.pop(injected)){
+		injectIds[0] = injected.commandId;
+		injectArguments[0].swap(injected.arguments);
+		insertCommands(injected.pos, injectIds, injectArguments); // Errors are reported by insertCommands
+	}
+
 	if(!hasCommands())
 		return false; // At the end of the non-existent script. Consider this the same as finished with a script
 
+	if(currentCommandIndex >= ((int)script->mainLength) && frames.empty())
+		return false; // Already finished (subroutine steps are after the main script but always have a frame)
+
+	// Sample the clock once. Every command sees the same time this tick.
+	int64_t now = clock->nowMicros();
+	tick.dt = (tickCount == 0) ? 0 : now - tick.now;
+	tick.now = now;
+	tick.index = tickCount++;
+
+	evaluateConditions();
+
 	// If the current command is done of there is no current command
-	if(currentCommand.get() == nullptr || currentCommand.get()->isComplete()){
-		// Move on to the next command
-		currentCommandIndex++;
-		currentCommand.release();
-		// If this is the end of the loadedCommands exit
-		if(currentCommandIndex >= ((int)loadedCommands.size()))
+	if(currentCommand == nullptr || currentCommand->isComplete()){
+		// Move on to the next command. If this is the end of the loaded commands exit
+		if(!nextCommand())
 			return false;
-		currentCommand = getCommand(loadedCommands[currentCommandIndex]);
 	}
 
 	// start or process the current command (if it were completed it will have been handled above)
 
-	if(!currentCommand.get()->hasStarted()){
-		currentCommand.get()->doStart(loadedArguments[currentCommandIndex]);
+	if(!currentCommand->hasStarted()){
+		currentCommand->doStart(script->arguments[currentCommandIndex], tick);
 	}else{
-		currentCommand.get()->doProcess();
+		currentCommand->doProcess(tick);
+	}
+
+	// A command that finished this tick hands over to the next one now instead of costing an extra tick.
+	// Commands can complete as they start (ex. a WAIT_UNTIL that is already true), so in a loop this could go on for
+	// millions of steps. At most one step per command in the script is handed over. The rest wait for the next tick.
+	size_t handovers = 0;
+	while(currentCommand->isComplete() && handovers++ < script->commands.size()){
+		if(!nextCommand())
+			return false;
+		currentCommand->doStart(script->arguments[currentCommandIndex], tick);
 	}
 
 	return true; // This is not the end of the loaded commands
 }
 
+bool AutoManager::nextCommand(){
+	currentCommand = nullptr;
+	int index = currentCommandIndex + 1;
+
+	// Subroutines are after the main script so reaching its end with no frames left is the end of the script
+	while(index < ((int)script->mainLength) || !frames.empty()){
+		int command = script->commands[index];
+		if(command >= 0){
+			currentCommandIndex = index;
+			currentCommand = script->objects[index];
+			// Commands in loops and subroutines run more than once. Clear what the last run left.
+			if(currentCommand->hasStarted())
+				currentCommand->doReset();
+			return true;
+		}
+
+		const std::vector<AutoArgument> &operands = script->arguments[index];
+		switch(command){
+		case AutoScript::CALL:
+			frames.push_back({ index + 1, 0 });
+			index = operands[0].getInt();
+			break;
+		case AutoScript::RETURN:
+			index = frames.back().index;
+			frames.pop_back();
+			break;
+		case AutoScript::REPEAT:
+			if(operands[0].getInt() > 0){
+				frames.push_back({ index + 1, (int)operands[0].getInt() }); // Counts are at most MAX_REPEAT (checked when loaded)
+				index++;
+			}else{
+				index = operands[1].getInt() + 1; // Skip past the LOOP
+			}
+			break;
+		case AutoScript::LOOP:
+			if(--frames.back().remaining > 0){
+				index = frames.back().index;
+			}else{
+				frames.pop_back();
+				index++;
+			}
+			break;
+		}
+	}
+
+	currentCommandIndex = script->mainLength;
+	return false;
+}
+
+void AutoManager::setProcessingThread(std::thread::id id){
+	processingThread.store(id);
+}
+
+void AutoManager::requestKill(){
+	killRequested.store(true, std::memory_order_release);
+}
+
+int AutoManager::getCurrentCommandIndex() const{
+	return currentCommandIndex;
+}
+
 void AutoManager::killAuto(){
-	if(currentCommand.get() != nullptr)
-		currentCommand.get()->doComplete();
-	currentCommandIndex = loadedCommands.size();
-	currentCommand.release();
+	std::thread::id owner = processingThread.load();
+	if(owner != std::thread::id() && owner != std::this_thread::get_id()){
+		// process is being called by another thread. Let it kill between ticks.
+		requestKill();
+		while(killRequested.load() && processingThread.load() == owner)
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		if(!killRequested.exchange(false))
+			return; // Done by the other thread
+		// The other thread stopped before it saw the request. Nothing else is using the script now.
+	}
+	if(currentCommand != nullptr && currentCommand->hasStarted() && !currentCommand->isComplete())
+		currentCommand->doComplete();
+	currentCommandIndex = script->mainLength;
+	currentCommand = nullptr;
+	frames.clear();
+	discardInjectedCommands();
+	killRequested.store(false, std::memory_order_release);
+}
+
+void AutoManager::restart(){
+	killAuto();
+	// Start over from the script as it was selected. Commands injected into the last run are not run again.
+	size_t selected = (script->source == nullptr) ? 0 : script->source->commands.size();
+	if(script->commands.size() != selected)
+		useScript(script->source);
+	for(AutoCommand *command : script->objects){
+		if(command != nullptr)
+			command->doReset();
+	}
+	currentCommandIndex = -1;
+	frames.reserve(script->maxDepth); // process never allocates frames
+	resetTicks();
 }
 
 void AutoManager::clearCommands(){
 	killAuto();
-	loadedCommands.clear();
-	loadedArguments.clear();
+	useScript(nullptr);
 	currentCommandIndex = -1;
+	resetTicks();
+}
+
+AutoManager::~AutoManager(){
+	stopWatching();
 }
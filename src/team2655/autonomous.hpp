@@ -15,23 +15,154 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <new>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "csvtokenizer.hpp"
+#include "profiler.hpp"
+#include "boundedqueue.hpp"
 
 namespace team2655{
 
+namespace compiledscript{
+struct ScriptLine;
+}
+
+/**
+ * The types an argument in an autonomous script can be parsed as
+ */
+enum class ArgumentType{
+	Int,    // A whole number (ex. -1)
+	Double, // Any number (ex. 0.5)
+	Bool,   // true/false, yes/no, or 1/0 (case insensitive)
+	Enum    // One of a fixed set of names (case insensitive). Stored as the index of the name.
+};
+
+/**
+ * Describes one argument a command expects (part of a command's schema)
+ */
+struct ArgumentSpec{
+	std::string name;                    // Used in error messages
+	ArgumentType type;
+	std::vector<std::string> enumValues; // Only used for ArgumentType::Enum
+
+	ArgumentSpec(std::string name, ArgumentType type, std::vector<std::string> enumValues = {});
+};
+
+/**
+ * A script argument that has already been parsed and validated (when the script was loaded)
+ */
+class AutoArgument{
+private:
+	ArgumentType type = ArgumentType::Int;
+	long int intValue = 0;   // Used for Int, Bool, and Enum
+	double doubleValue = 0;  // Used for Double
+
+public:
+	AutoArgument() = default;
+
+	static AutoArgument fromInt(long int value);
+	static AutoArgument fromDouble(double value);
+	static AutoArgument fromBool(bool value);
+	static AutoArgument fromEnum(int index);
+
+	/**
+	 * Parse an argument from its text in a script
+	 * @param text The text of the argument (surrounding whitespace should already be trimmed)
+	 * @param spec The expected argument
+	 * @param result Where to store the parsed argument
+	 * @param error A description of the problem if parsing fails
+	 * @return Was the argument successfully parsed
+	 */
+	static bool parse(StringRef text, const ArgumentSpec &spec, AutoArgument &result, std::string &error);
+
+	ArgumentType getType() const;
+
+	/**
+	 * Get the value as an integer. Doubles are truncated. Enums return the index of the enum value.
+	 */
+	long int getInt() const;
+
+	/**
+	 * Get the value as a double (works for all types)
+	 */
+	double getDouble() const;
+
+	/**
+	 * Get the value as a bool. Numbers are true if non-zero
+	 */
+	bool getBool() const;
+};
+
+/**
+ * A source of monotonic time for autonomous. Replace the AutoManager's clock to run faster than real time
+ * (simulations) or with exact timing (tests).
+ */
+class AutoClock{
+public:
+	/**
+	 * Get the current time in microseconds. Must never go backwards. The starting point does not matter.
+	 */
+	virtual int64_t nowMicros() = 0;
+
+	virtual ~AutoClock() {  }
+};
+
+/**
+ * The default clock. Uses std::chrono::steady_clock so it is not affected by changes to the system (wall) time.
+ */
+class SteadyAutoClock : public AutoClock{
+public:
+	int64_t nowMicros() override;
+};
+
+/**
+ * A clock that only moves when told to
+ */
+class ManualAutoClock : public AutoClock{
+private:
+	int64_t now = 0;
+public:
+	int64_t nowMicros() override;
+
+	void setMicros(int64_t now);
+	void advanceMicros(int64_t amount);
+};
+
+/**
+ * Timing information for one call to AutoManager::process. Sampled once per tick so every command sees the same time.
+ */
+struct TickContext{
+	int64_t now = 0;    // Time of this tick in microseconds (from the AutoManager's clock)
+	int64_t dt = 0;     // Microseconds since the previous tick (0 for the first tick)
+	uint64_t index = 0; // Number of ticks before this one since the script was loaded or restarted
+};
 
 class AutoCommand{
 protected:
 	bool _hasStarted = false;
 	bool _isComplete = false;
-	int timeout = 0;
-	long int startTime = 0;
-	std::vector<std::string> arguments;
+	int64_t timeout = 0;   // Microseconds
+	int64_t startTime = 0; // Microseconds (from the tick the command started on)
+	std::vector<AutoArgument> arguments;
+
+	/**
+	 * The tick the command is currently running in (set by doStart and doProcess)
+	 */
+	TickContext tick;
 
 	/**
-	 * Get the current time as milliseconds from the epoch
-	 * @return Number of milliseconds since the epoch
+	 * Where execution times are recorded. Never null.
 	 */
-	static long int currentTimeMillis();
+	CommandProfile *profile = &CommandProfile::none;
+
+	void runStart(const std::vector<AutoArgument> &args, const TickContext &tick);
+	void runProcess(const TickContext &tick);
+	void runComplete();
 
 	/**
 	 * Check if the command has timed out
@@ -44,19 +175,40 @@ public:
 	/**
 	 * Start the command
 	 * @param args THe arguments provided for the command
+	 * @param tick The current tick
 	 */
-	void doStart(std::vector<std::string> args);
+	void doStart(const std::vector<AutoArgument> &args, const TickContext &tick);
 
 	/**
 	 * Periodic actions for the command
+	 * @param tick The current tick
 	 */
-	void doProcess();
+	void doProcess(const TickContext &tick);
+
+	/**
+	 * Prepare the command when its script is loaded. Keeps a copy of the arguments so starting the command later
+	 * does not allocate, then calls prepare.
+	 * @param args The arguments the command will be started with
+	 * @return Can the command run with these arguments
+	 */
+	bool doPrepare(const std::vector<AutoArgument> &args);
 
 	/**
 	 * Complete / finish the command
 	 */
 	void doComplete();
 
+	/**
+	 * Put the command back in its initial state so it can be run again
+	 */
+	void doReset();
+
+	/**
+	 * Set where execution times for this command are recorded (done by the AutoManager)
+	 * @param profile The profile. nullptr to not record.
+	 */
+	void setProfile(CommandProfile *profile);
+
 	/**
 	 * Has the command been started (init called)
 	 * @return true if started, false if not
@@ -71,21 +223,54 @@ public:
 
 	/**
 	 * Set the timeout for this command
-	 * @param timeoutMs The timeout in milliseconds
+	 * @param timeoutMs The timeout in milliseconds. A negative timeout means the command never times out.
 	 */
 	void setTimeout(int timeoutMs);
 
+	/**
+	 * Set the timeout for this command
+	 * @param timeoutUs The timeout in microseconds. A negative timeout means the command never times out.
+	 */
+	void setTimeoutMicros(int64_t timeoutUs);
+
+	/**
+	 * Set the timeout for this command (ex. from a script argument)
+	 * @param timeoutSeconds The timeout in seconds. A negative timeout means the command never times out.
+	 *                       Timeouts too long for microseconds to fit in an int64_t are treated as never.
+	 */
+	void setTimeoutSeconds(double timeoutSeconds);
+
 	/**
 	 * Get the timeout for this command
 	 * @return The timeout for this command in milliseconds
 	 */
 	int getTimeout();
 
+	/**
+	 * Get the timeout for this command
+	 * @return The timeout for this command in microseconds
+	 */
+	int64_t getTimeoutMicros();
+
+	/**
+	 * Get the arguments this command expects (in order). Scripts are checked against this when loaded.
+	 * Any extra columns after these arguments are ignored (can be used as comments).
+	 * @return The schema for this command's arguments
+	 */
+	virtual std::vector<ArgumentSpec> getArgumentSpecs() = 0;
+
+	/**
+	 * Do work that only depends on the arguments (ex. generating a motion profile) when the script is loaded
+	 * instead of when the command runs. Called once for each command in a script with the arguments start will get.
+	 * @return Can the command run with these arguments (false fails the load)
+	 */
+	virtual bool prepare(const std::vector<AutoArgument> &) { return true; }
+
 	/**
 	 * Handle when the command starts
-	 * @param args The arguments provided for the command
+	 * @param args The arguments provided for the command (already parsed according to getArgumentSpecs)
 	 */
-	virtual void start(std::vector<std::string> args) = 0;
+	virtual void start(const std::vector<AutoArgument> &args) = 0;
 
 	/**
 	 * Handle periodic functions for the command
@@ -97,23 +282,294 @@ public:
 	 */
 	virtual void complete() = 0;
 
+	/**
+	 * Reset any state the command keeps between start and complete. Commands are reused between runs of a script.
+	 */
+	virtual void reset() {  }
+
 	virtual ~AutoCommand() {  }
 };
 
+/**
+ * A command that runs other commands. In scripts a group starts with a line containing only the group's name
+ * (PARALLEL, SEQUENCE, or RACE) and ends with a line containing only END. Groups can be nested but can not be empty.
+ *     SEQUENCE - runs its commands one after another. Done when the last one is done.
+ *     PARALLEL - runs all of its commands at the same time. Done when all of them are done.
+ *     RACE     - runs all of its commands at the same time. Done when any of them is done (the rest are completed early).
+ */
+class CommandGroup : public AutoCommand{
+public:
+	enum class Type{ Sequence, Parallel, Race };
+
+protected:
+	Type type;
+	std::vector<AutoCommand*> commands;
+	std::vector<std::vector<AutoArgument>> commandArguments;
+	size_t currentIndex = 0; // The running command for a sequence
+
+	/**
+	 * Start the next command in a sequence for each one that is done (all in the same tick). Completes the group after the last.
+	 */
+	void advanceSequence();
+
+	/**
+	 * Complete a parallel group when all commands are done or a race when any is done
+	 */
+	void checkParallel();
+
+public:
+	explicit CommandGroup(Type type);
+
+	/**
+	 * Add a command to the end of the group
+	 * @param command The command. Not owned by the group.
+	 * @param args The (already parsed) arguments for the command
+	 */
+	void addCommand(AutoCommand *command, const std::vector<AutoArgument> &args);
+
+	Type getType() const;
+
+	/**
+	 * @return The number of commands added to the group
+	 */
+	size_t getCommandCount() const;
+
+	std::vector<ArgumentSpec> getArgumentSpecs() override;
+	void start(const std::vector<AutoArgument> &args) override;
+	void process() override;
+	void complete() override;
+	void reset() override;
+};
+
+class SequenceGroup : public CommandGroup{
+public:
+	SequenceGroup() : CommandGroup(Type::Sequence) {  }
+};
+
+class ParallelGroup : public CommandGroup{
+public:
+	ParallelGroup() : CommandGroup(Type::Parallel) {  }
+};
+
+class RaceGroup : public CommandGroup{
+public:
+	RaceGroup() : CommandGroup(Type::Race) {  }
+};
+
+/**
+ * How a condition's source value is tested (see AutoManager::registerCondition)
+ */
+enum class ConditionType{
+	AtLeast, // True while the value is >= the threshold (ex. an encoder distance)
+	AtMost,  // True while the value is <= the threshold
+	Rising,  // True for the one tick the value goes from below the threshold to >= it (ex. a digital input being pressed)
+	Falling  // True for the one tick the value goes from >= the threshold to below it
+};
+
+/**
+ * Reads the value a condition tests (ex. a sensor). Called once per tick while a script is running.
+ */
+typedef double (*ConditionSource)();
+
+/**
+ * A built in command that is done on the tick its condition is true. The manager sets where condition results are read from.
+ * Usage in scripts: WAIT_UNTIL,condition   Use it in a RACE to end other commands early.
+ */
+class WaitUntilCommand : public AutoCommand{
+protected:
+	const std::vector<char> *conditionValues = nullptr; // One entry per condition (owned by the manager)
+	size_t condition = 0;
+
+public:
+	void setConditionValues(const std::vector<char> *conditionValues);
+
+	std::vector<ArgumentSpec> getArgumentSpecs() override;
+	void start(const std::vector<AutoArgument> &args) override;
+	void process() override;
+	void complete() override;
+};
+
+/**
+ * Constructs a new instance of a registered AutoCommand in the given memory (placement new)
+ */
+typedef AutoCommand* (*CommandFactory)(void *memory);
+
+/**
+ * A bump allocator that AutoCommand objects are constructed in.
+ * Memory is allocated in blocks that are kept (and reused) until the arena is destroyed, so after the first
+ * script is loaded creating commands for the next script normally does not touch the heap.
+ */
+class CommandArena{
+private:
+	static const size_t BLOCK_SIZE = 4096;
+
+	std::vector<std::unique_ptr<char[]>> blocks;
+	std::vector<size_t> blockSizes;
+	size_t currentBlock = 0;
+	size_t used = 0;               // Bytes used in the current block
+	std::vector<AutoCommand*> objects; // Everything constructed in the arena (in order)
+
+	void *allocate(size_t size, size_t align);
+
+public:
+	CommandArena() = default;
+	CommandArena(const CommandArena&) = delete;
+	CommandArena& operator=(const CommandArena&) = delete;
+
+	/**
+	 * Construct a command in the arena
+	 * @param factory The factory for the command
+	 * @param size sizeof the command type
+	 * @param align alignof the command type
+	 * @return The new command. Owned by the arena.
+	 */
+	AutoCommand *create(CommandFactory factory, size_t size, size_t align);
+
+	/**
+	 * Make sure commands can be created without allocating
+	 * @param bytes Room needed for the commands (include padding for alignment)
+	 * @param count How many commands
+	 */
+	void reserve(size_t bytes, size_t count);
+
+	/**
+	 * Destroy every command in the arena (newest first). Memory is kept for reuse.
+	 */
+	void clear();
+
+	~CommandArena();
+};
+
+/**
+ * Hash for command names that ignores case (so "drive" and "DRIVE" are the same command)
+ */
+struct CaseInsensitiveHash{
+	size_t operator()(const std::string &str) const;
+};
+
+/**
+ * Compare command names ignoring case
+ */
+struct CaseInsensitiveEqual{
+	bool operator()(const std::string &a, const std::string &b) const;
+};
+
+/**
+ * A script that has been loaded and is ready to run. Owns the objects for all of its commands.
+ */
+struct AutoScript{
+	std::string name;
+
+	/**
+	 * Control steps (DEFINE/CALL/REPEAT in scripts). These are stored in commands in place of a command id.
+	 * Their operands are in arguments (all Int) and their object is nullptr.
+	 */
+	static const int CALL = -1;   // Run a subroutine. Operands: index of the subroutine's first step
+	static const int RETURN = -2; // End of a subroutine
+	static const int REPEAT = -3; // Run the steps up to the matching LOOP count times. Operands: count, index of the LOOP
+	static const int LOOP = -4;   // End of a REPEAT
+
+	static const long int MAX_REPEAT = 10000; // Most times a REPEAT can run
+
+	/**
+	 * A list of commands (ids of registered commands or control steps) loaded from a file.
+	 * Only top level commands are listed here. Commands inside a group are owned by the group's object.
+	 * The main script comes first. Subroutines are stored once after it so calling or repeating them copies nothing.
+	 */
+	std::vector<int> commands;
+
+	/**
+	 * A list of arguments for each command (each command can have multiple arguments)
+	 */
+	std::vector<std::vector<AutoArgument>> arguments;
+
+	/**
+	 * The object for each command. These are all created when commands are loaded/added
+	 * so nothing is allocated while auto is running.
+	 */
+	std::vector<AutoCommand*> objects;
+
+	/**
+	 * The number of steps in the main script. The rest are subroutines.
+	 */
+	size_t mainLength = 0;
+
+	/**
+	 * The most CALL/REPEAT frames that can be active at once (the AutoManager reserves this much stack)
+	 */
+	size_t maxDepth = 0;
+
+	/**
+	 * Owns the memory for objects. A script being run only owns the objects for added commands (see source).
+	 */
+	CommandArena arena;
+
+	/**
+	 * The cached script this one was copied from. Keeps the rest of the objects alive.
+	 */
+	std::shared_ptr<AutoScript> source;
+};
+
 /**
  * A class to handle loading of autonomous command scripts and running AutoCommand objects
  */
 class AutoManager{
 protected:
 	/**
-	 * A list of commands loaded from a file
+	 * A command type registered with registerCommand
 	 */
-	std::vector<std::string> loadedCommands;
+	struct RegisteredCommand{
+		std::string name;
+		CommandFactory factory;
+		size_t size;
+		size_t align;
+		std::vector<ArgumentSpec> argumentSpecs; // Captured once when the command is registered
+	};
 
 	/**
-	 * A list of arguments for each command (each command can have multiple arguments)
+	 * All registered command types. The index in this list is the command's id.
+	 */
+	std::vector<RegisteredCommand> registeredCommands;
+
+	/**
+	 * Maps a command name (any case) to its id
+	 */
+	std::unordered_map<std::string, int, CaseInsensitiveHash, CaseInsensitiveEqual> commandIds;
+
+	/**
+	 * Execution time profile for each registered command (same index as registeredCommands)
+	 */
+	std::vector<std::unique_ptr<CommandProfile>> profiles;
+	bool profiling = false;
+
+	/**
+	 * The script that is being run. Never null. This is a copy of the selected script (see useScript) so commands
+	 * added while it runs never change scriptCache.
+	 */
+	std::shared_ptr<AutoScript> script;
+
+	/**
+	 * Scripts that have already been parsed (by preloadScripts, loadScript, or the watcher thread) keyed by file name
+	 */
+	std::unordered_map<std::string, std::shared_ptr<AutoScript>> scriptCache;
+
+	/**
+	 * Protects scriptCache (the watcher thread updates it)
+	 */
+	std::mutex scriptCacheMutex;
+
+	/**
+	 * Switch to running a copy of a script. The copy shares the cached script's command objects (restart resets them)
+	 * and has room reserved for INJECT_QUEUE_SIZE added commands. Injected commands still queued are dropped.
+	 * @param cached The script to run (nullptr for an empty script)
+	 */
+	void useScript(const std::shared_ptr<AutoScript> &cached);
+
+	/**
+	 * Re-parses scripts that change in the script directory
 	 */
-	std::vector<std::vector<std::string>> loadedArguments;
+	std::thread watchThread;
+	std::atomic<bool> watching{false};
 
 	/**
 	 * The index of the command that is currently being executed
@@ -121,9 +577,144 @@ protected:
 	int currentCommandIndex = -1;
 
 	/**
-	 * The object for the command that is currently being executed
+	 * The object for the command that is currently being executed (one of script->objects)
+	 */
+	AutoCommand *currentCommand = nullptr;
+
+	/**
+	 * Where time comes from. Not owned.
+	 */
+	AutoClock *clock;
+
+	/**
+	 * The current (or last) tick
+	 */
+	TickContext tick;
+
+	/**
+	 * An active CALL or REPEAT
+	 */
+	struct ScriptFrame{
+		int index;     // Where a CALL returns to or where a REPEAT's steps start
+		int remaining; // Times left to run a REPEAT (0 for a CALL)
+	};
+
+	/**
+	 * Active CALLs and REPEATs (innermost last). Reserved to the script's maxDepth when it is (re)started.
+	 */
+	std::vector<ScriptFrame> frames;
+
+	/**
+	 * A command added by injectCommand (already validated)
+	 */
+	struct InjectedCommand{
+		int commandId = -1;
+		int pos = -1;
+		std::vector<AutoArgument> arguments;
+	};
+
+	/**
+	 * Commands from other threads. process adds them at the start of each tick.
+	 */
+	BoundedQueue<InjectedCommand> injectedCommands{INJECT_QUEUE_SIZE};
+
+	/**
+	 * Drop every queued injected command. They were meant for the run that is being killed or replaced.
+	 * Only call this where popping is allowed (the thread calling process, or when nothing is processing).
+	 */
+	void discardInjectedCommands();
+
+	/**
+	 * Number of injected commands dropped because the queue was full
+	 */
+	std::atomic<uint64_t> injectOverflows{0};
+
+	/**
+	 * Reused by process to pass each injected command to insertCommands (instead of building temporary lists every tick)
+	 */
+	std::vector<int> injectIds = std::vector<int>(1);
+	std::vector<std::vector<AutoArgument>> injectArguments = std::vector<std::vector<AutoArgument>>(1);
+
+	/**
+	 * The objects being added by insertCommands (reserved so adding a few commands does not allocate)
+	 */
+	std::vector<AutoCommand*> insertObjects;
+
+	/**
+	 * A condition registered with registerCondition
+	 */
+	struct Condition{
+		ConditionSource source;
+		ConditionType type;
+		double threshold;
+		double last;  // The value from the previous tick (for edges)
+		bool hasLast; // Is last valid (false until the first tick after a restart)
+	};
+
+	/**
+	 * All registered conditions. The index is the condition's id (and its value for WAIT_UNTIL's argument).
+	 */
+	std::vector<Condition> conditions;
+
+	/**
+	 * The result of each condition for the current tick (same index as conditions). Read by WAIT_UNTIL commands.
+	 */
+	std::vector<char> conditionValues;
+
+	/**
+	 * The command id of WAIT_UNTIL
+	 */
+	int waitUntilId = -1;
+
+	/**
+	 * Read every condition's source and update conditionValues. Done once at the start of each tick so commands
+	 * that depend on a condition can finish (and the next command start) on the tick it becomes true.
+	 */
+	void evaluateConditions();
+
+	/**
+	 * Move to the next command in the script, following any CALL/REPEAT steps on the way
+	 * @return Is there a command (false at the end of the script)
+	 */
+	bool nextCommand();
+
+	/**
+	 * Insert top level commands into the main script and move anything that points after them (control step operands,
+	 * the current command, and active frames)
+	 * @param pos Where to insert (-1 or beyond the main script for the end)
+	 * @param ids The command ids
+	 * @param arguments The arguments for each command. They are moved into the script (left empty) if the commands are added.
+	 * @return Were the commands added (false if one could not be prepared. Nothing is added.)
+	 */
+	bool insertCommands(int pos, const std::vector<int> &ids, std::vector<std::vector<AutoArgument>> &arguments);
+
+	/**
+	 * Number of ticks processed since the script was loaded or restarted
+	 */
+	uint64_t tickCount = 0;
+
+	/**
+	 * Start counting ticks from zero again
+	 */
+	void resetTicks();
+
+	/**
+	 * Set by requestKill. process does the kill at the start of the next tick then clears it.
+	 */
+	std::atomic<bool> killRequested{false};
+
+	/**
+	 * The thread calling process if it is not the thread that owns the robot (set by AutoExecutor). Default id if none.
+	 */
+	std::atomic<std::thread::id> processingThread;
+
+	/**
+	 * Tell killAuto which other thread is calling process
+	 * @param id The thread's id or a default constructed id when it stops
 	 */
-	std::unique_ptr<AutoCommand> currentCommand{nullptr};
+	void setProcessingThread(std::thread::id id);
+
+	friend class AutoExecutor;
 
 	/**
 	 * Get the directory for autonomous scripts
@@ -132,24 +723,203 @@ protected:
 	virtual std::string getScriptDir() = 0;
 
 	/**
-	 * Get a unique_ptr to a new AutoCommand object based on the command name
-	 * @param commandName The name of the command
-	 * @return A unique pointer to a new AutoCommand child class
+	 * Register a type of command so it can be used in scripts. Call this from the constructor of a custom AutoManager.
+	 * @param name The name used for the command in scripts (case insensitive)
+	 * @param factory A function that constructs the command in the memory it is given
+	 * @param size The size of the command type
+	 * @param align The alignment of the command type
+	 * @return Was the command registered (false if the name is already used)
+	 */
+	bool registerCommand(const std::string &name, CommandFactory factory, size_t size, size_t align);
+
+	/**
+	 * Register a type of command so it can be used in scripts. Call this from the constructor of a custom AutoManager.
+	 * @param name The name used for the command in scripts (case insensitive)
+	 * @return Was the command registered (false if the name is already used)
+	 */
+	template<class T>
+	bool registerCommand(const std::string &name){
+		return registerCommand(name, [](void *memory) -> AutoCommand* { return new (memory) T(); }, sizeof(T), alignof(T));
+	}
+
+	/**
+	 * Register a condition that scripts can wait for with WAIT_UNTIL,name. Call this from the constructor of a custom AutoManager
+	 * (after that the list of conditions must not change). Conditions are stored in compiled scripts by index so tools that
+	 * compile scripts must register the same conditions in the same order.
+	 * @param name The name used for the condition in scripts (case insensitive)
+	 * @param source Reads the value to test. Called once per tick while a script is running.
+	 * @param type How the value is tested
+	 * @param threshold The value is compared to this
+	 * @return Was the condition registered (false if the name is already used)
+	 */
+	bool registerCondition(const std::string &name, ConditionSource source, ConditionType type, double threshold);
+
+	/**
+	 * Create the object for a registered command
+	 * @param commandId The id of the command (from findCommand)
+	 * @param arena Where to create the command
+	 * @return The new command. Owned by the arena.
+	 */
+	AutoCommand *createCommand(int commandId, CommandArena &arena) const;
+
+	/**
+	 * Parse and validate the arguments for a command against the command's schema
+	 * @param commandId The id of the command
+	 * @param arguments The arguments as text
+	 * @param argumentCount The number of arguments
+	 * @param result Where to store the parsed arguments
+	 * @param error A description of the problem if parsing fails. Includes the (1 based) column
+	 * @return Were the arguments valid
+	 */
+	bool parseArguments(int commandId, const StringRef *arguments, size_t argumentCount,
+			            std::vector<AutoArgument> &result, std::string &error) const;
+
+	/**
+	 * Parse the text of a CSV script into lines (the same form compiled scripts are stored in).
+	 * Only uses the registered commands so it is safe to call from the watcher thread.
+	 * @param scriptName The name of the script (for error messages)
+	 * @param scriptText The contents of the script
+	 * @param strings Where to put the names of the commands that are used
+	 * @param lines Where to put the lines (names are indices in strings)
+	 * @return Was the script valid
+	 */
+	bool parseScriptLines(const std::string &scriptName, const std::string &scriptText,
+			              std::vector<std::string> &strings, std::vector<compiledscript::ScriptLine> &lines) const;
+
+	/**
+	 * Create the command objects for parsed (or compiled) lines. Checks groups and that arguments match the registered commands.
+	 * @param scriptName The name of the script (for error messages)
+	 * @param strings The names of the commands used by lines
+	 * @param lines The lines of the script
+	 * @param result Where to put the commands
+	 * @return Was the script valid
+	 */
+	bool buildScript(const std::string &scriptName, const std::vector<std::string> &strings,
+			         const std::vector<compiledscript::ScriptLine> &lines, AutoScript &result) const;
+
+	/**
+	 * Read and parse a script (CSV or compiled) then put it in scriptCache (replacing any older version)
+	 * @param scriptDir The directory the script is in
+	 * @param scriptName The file name of the script
+	 * @return The parsed script or nullptr if it could not be read or is invalid (the cache is not changed)
 	 */
-	virtual std::unique_ptr<AutoCommand> getCommand(std::string commandName) = 0;
+	std::shared_ptr<AutoScript> cacheScript(const std::string &scriptDir, const std::string &scriptName);
 
 	/**
-	 * Split a string by a character delimiter
-	 * @param s The string to split
-	 * @param delimiter The delimiter to split by
-	 * @return A vector of strings (the specific segments)
+	 * Body of the watcher thread
+	 * @param inotifyFd The inotify instance watching the script directory. Closed when the thread stops.
+	 * @param scriptDir The script directory
 	 */
-	std::vector<std::string> split(const std::string& s, char delimiter);
+	void watchScripts(int inotifyFd, std::string scriptDir);
 
 public:
 
 	/**
-	 * Load an autonomous CSV script from the script path
+	 * Registers the built in commands (SEQUENCE, PARALLEL, RACE, and WAIT_UNTIL)
+	 */
+	AutoManager();
+
+	/**
+	 * Set where the AutoManager gets time from
+	 * @param clock The clock (must outlive the AutoManager). nullptr for the default steady clock.
+	 */
+	void setClock(AutoClock *clock);
+
+	/**
+	 * Get the current (or most recent) tick
+	 */
+	const TickContext &getTick() const;
+
+	/**
+	 * Turn timing of every command's start, process, and complete on or off. Off by default.
+	 * When off the only cost is one branch per call.
+	 */
+	void setProfilingEnabled(bool enabled);
+
+	bool isProfilingEnabled() const;
+
+	/**
+	 * Get the execution times recorded for a command. Safe to read from any thread.
+	 * @param commandName The name of the command (case insensitive)
+	 * @return The profile or nullptr if there is no command with this name
+	 */
+	const CommandProfile *getProfile(const std::string &commandName) const;
+
+	/**
+	 * Clear all recorded execution times
+	 */
+	void resetProfiles();
+
+	/**
+	 * Write the recorded execution times to a CSV file (one row per command and phase, times in microseconds).
+	 * Call this at the end of autonomous (ex. from DisabledInit or TeleopInit). Do not call it from the control loop.
+	 * @param path The file to write
+	 * @return Was the file written
+	 */
+	bool writeProfileCSV(const std::string &path) const;
+
+	/**
+	 * Get the result of a condition for the current (or last) tick
+	 * @param name The name of the condition (case insensitive)
+	 * @return Is the condition true (false if there is no condition with this name)
+	 */
+	bool getCondition(const std::string &name) const;
+
+	/**
+	 * Get the id of a registered command
+	 * @param name The name of the command (case insensitive)
+	 * @return The command's id or -1 if no command has this name
+	 */
+	int findCommand(const std::string &name) const;
+
+	/**
+	 * Parse every script (*.csv and compiled *.auto) in the script directory and keep them in memory so selectScript does not
+	 * need to read or parse anything. Call from RobotInit or while disabled.
+	 * @return Could the script directory be read. Invalid scripts are reported and skipped.
+	 */
+	bool preloadScripts();
+
+	/**
+	 * Use a script that was already parsed (by preloadScripts, loadScript, or the watcher)
+	 * Stops the current command and starts the selected script from the beginning. No file access or parsing.
+	 * @param scriptName The file name of the script
+	 * @return Was the script in the cache
+	 */
+	bool selectScript(const std::string &scriptName);
+
+	/**
+	 * Start a background thread that re-parses scripts in the script directory when they change (ex. uploaded over SFTP).
+	 * Changed scripts are used the next time they are selected. A script that is running is not changed.
+	 * @return Was the watcher started
+	 */
+	bool startWatching();
+
+	/**
+	 * Stop the watcher thread started by startWatching
+	 */
+	void stopWatching();
+
+	/**
+	 * Validate a CSV script and write it in the compiled (binary) format. Compiled scripts (.auto) load without any parsing.
+	 * Used by the autoc tool so errors are found before deploying.
+	 * @param inputPath The CSV script
+	 * @param outputPath Where to write the compiled script
+	 * @return Was the script valid and written
+	 */
+	bool compileScript(const std::string &inputPath, const std::string &outputPath);
+
+	/**
+	 * Load an autonomous script from the script path (and add it to the cache).
+	 * Files ending in .auto are loaded as compiled scripts. Anything else is loaded as a CSV script.
+	 * All command names and arguments are resolved and validated here. If any line is invalid nothing is loaded.
+	 * Blank lines are skipped. Any columns after a command's arguments are ignored (use them for comments).
+	 * Lines between a group name (SEQUENCE, PARALLEL, RACE) and END are added to that group (see CommandGroup).
+	 * Repeated patterns can be written once (not inside groups):
+	 *     DEFINE,name ... END   - a subroutine (only at the top level, before it is used)
+	 *     CALL,name             - run a subroutine
+	 *     REPEAT,n ... END      - run the lines n times (up to AutoScript::MAX_REPEAT). The lines must run a command.
+	 * WAIT_UNTIL,condition waits for a condition from registerCondition (ex. in a RACE with a DRIVE to stop when a sensor trips).
+	 * Subroutines and loops are not expanded. Their commands are stored once and reused each time they run.
 	 * @param scriptName The name of the script to load
 	 * @return Was the script successfully loaded
 	 */
@@ -157,19 +927,46 @@ public:
 
 	/**
 	 * Add a command to autonomous
+	 * Commands are added to the script being run. Cached scripts are not changed (the next selectScript starts without them).
 	 * @param command The command
 	 * @param arguments The arguments for the command
 	 * @param pos The position to insert the command at (-1 for the end of the loaded script).
+	 * @return Was the command added (false if the command or its arguments are invalid)
 	 */
-	void addCommand(std::string command, std::vector<std::string> arguments, int pos = -1);
+	bool addCommand(std::string command, std::vector<std::string> arguments, int pos = -1);
 
 	/**
 	 * Add a set of commands to the end of autonomous
 	 * @param commands The commands (command names) of the commands to execute
 	 * @param arguments The arguments for each command
 	 * @param pos THe position to insert the command at (-1 for the end of the loaded script).
+	 * @return Were the commands added (if any are invalid none are added)
+	 */
+	bool addCommands(std::vector<std::string> commands, std::vector<std::vector<std::string>> arguments, int pos = -1);
+
+	/**
+	 * The most injected commands that can be waiting for process at once
+	 */
+	static const size_t INJECT_QUEUE_SIZE = 64;
+
+	/**
+	 * Add a command from another thread (ex. a vision thread adding a ROTATE to a target) while auto is running.
+	 * The command is checked here then queued without locking. process adds queued commands at the start of its next tick.
+	 * Commands added after the script has finished (or was killed) are not run. Commands still queued when the script is
+	 * killed, restarted or changed are dropped, and restart removes the ones already added. Room for INJECT_QUEUE_SIZE commands is
+	 * reserved when a script is selected, so adding one only allocates for the command's copy of its arguments and for
+	 * whatever its prepare does (ex. generating a motion profile).
+	 * @param command The command
+	 * @param arguments The arguments for the command
+	 * @param pos The position in the main script to insert the command at when it is added (-1 for the end)
+	 * @return Was the command queued (false if it is invalid or the queue is full)
+	 */
+	bool injectCommand(const std::string &command, const std::vector<std::string> &arguments, int pos = -1);
+
+	/**
+	 * Get the number of injected commands that were dropped because the queue was full. Safe from any thread.
 	 */
-	void addCommands(std::vector<std::string> commands, std::vector<std::vector<std::string>> arguments, int pos = -1);
+	uint64_t getInjectOverflowCount() const;
 
 	/**
 	 * Does the AutoManager have a script loaded/inserted
@@ -179,18 +976,40 @@ public:
 
 	/**
 	 * Process the current command (and move on if needed)
+	 * The clock is sampled once here and the same tick is given to every command that runs. Conditions are evaluated next.
+	 * When a command finishes the next one is started in the same tick.
 	 * @return Is currently processing a command (not the end of the script). Returns false when script is complete.
 	 */
 	bool process();
 
 	/**
-	 * End the current command calling its complete method so that everything ends properly then move to the end of the script
+	 * End the current command calling its complete method so that everything ends properly then move to the end of the script.
+	 * If an AutoExecutor is running process on another thread the kill is done by that thread between ticks and this waits for it.
 	 */
 	void killAuto();
 
+	/**
+	 * Ask for the script to be killed at the start of the next call to process. Lock free, safe from any thread.
+	 */
+	void requestKill();
+
+	/**
+	 * Get the index of the command being run (-1 before the first tick, the length of the main script when finished)
+	 */
+	int getCurrentCommandIndex() const;
+
+	/**
+	 * Stop the current command (like killAuto) and reset every command so the loaded script runs again from the beginning.
+	 * The same command objects are reused.
+	 */
+	void restart();
+
+	/**
+	 * Stop the current command and switch to a new empty script. Cached scripts are not changed.
+	 */
 	void clearCommands();
 
-	virtual ~AutoManager() {  }
+	virtual ~AutoManager();
 };
 
 
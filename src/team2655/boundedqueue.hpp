@@ -0,0 +1,109 @@
+/**
+ * boundedqueue.hpp
+ * A fixed size lock free queue for passing values between threads
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace team2655{
+
+/**
+ * A bounded multi producer queue (any number of threads can push, one thread pops).
+ * Each cell has a sequence number that says whose turn it is so push and pop never lock or wait.
+ * All memory is allocated when the queue is created. push fails (instead of blocking) when the queue is full.
+ */
+template<class T>
+class BoundedQueue{
+private:
+	struct Cell{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Keep the producer and consumer positions on different cache lines
+	char pad0[64];
+	std::atomic<size_t> pushPos{0};
+	char pad1[64];
+	std::atomic<size_t> popPos{0};
+	char pad2[64];
+
+public:
+	/**
+	 * @param capacity The most values the queue can hold (rounded up to a power of two)
+	 */
+	explicit BoundedQueue(size_t capacity){
+		size_t size = 2;
+		while(size < capacity)
+			size *= 2;
+		cells.reset(new Cell[size]);
+		mask = size - 1;
+		for(size_t i = 0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/**
+	 * Add a value. Safe from any thread.
+	 * @param value The value (moved into the queue if there is room)
+	 * @return Was there room
+	 */
+	bool push(T &&value){
+		size_t pos = pushPos.load(std::memory_order_relaxed);
+		for(;;){
+			Cell &cell = cells[pos & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)pos;
+			if(difference == 0){
+				// The cell is free. Claim it (another producer may get it first).
+				if(pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					cell.value = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}else if(difference < 0){
+				return false; // Full
+			}else{
+				pos = pushPos.load(std::memory_order_relaxed); // Another producer claimed it
+			}
+		}
+	}
+
+	/**
+	 * Remove the oldest value. Only call this from one thread (the consumer).
+	 * @param value Where to move the value
+	 * @return Was there a value
+	 */
+	bool pop(T &value){
+		size_t pos = popPos.load(std::memory_order_relaxed);
+		Cell &cell = cells[pos & mask];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if((std::ptrdiff_t)sequence - (std::ptrdiff_t)(pos + 1) < 0)
+			return false; // Empty (or the producer has not finished writing it)
+		value = std::move(cell.value);
+		popPos.store(pos + 1, std::memory_order_relaxed);
+		cell.sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * The most values the queue can hold
+	 */
+	size_t capacity() const{
+		return mask + 1;
+	}
+};
+
+}
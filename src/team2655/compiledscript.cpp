@@ -0,0 +1,221 @@
+/**
+ * compiledscript.cpp
+ * See compiledscript.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "compiledscript.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace team2655;
+using namespace team2655::compiledscript;
+
+// FNV-1a
+static uint32_t checksum(const char *data, size_t length){
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; i++){
+		hash ^= (uint8_t)data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+template<class T>
+static void append(std::string &out, const T &value){
+	out.append((const char*)&value, sizeof(T));
+}
+
+bool compiledscript::write(const std::string &path, const std::vector<std::string> &strings, const std::vector<ScriptLine> &lines, std::string &error){
+	// Build everything after the header first so the checksum can be calculated
+	std::string body;
+
+	uint32_t offset = 0;
+	for(const std::string &str : strings){
+		append(body, offset);
+		offset += str.size();
+	}
+	append(body, offset);
+
+	uint32_t argumentCount = 0;
+	for(const ScriptLine &line : lines){
+		Record record;
+		record.name = line.name;
+		record.line = line.line;
+		record.firstArgument = argumentCount;
+		record.argumentCount = line.arguments.size();
+		append(body, record);
+		argumentCount += line.arguments.size();
+	}
+
+	for(const ScriptLine &line : lines){
+		for(const AutoArgument &arg : line.arguments){
+			Argument argument;
+			argument.type = (uint32_t)arg.getType();
+			argument.unused = 0;
+			argument.intValue = arg.getInt();
+			argument.doubleValue = arg.getDouble();
+			append(body, argument);
+		}
+	}
+
+	for(const std::string &str : strings)
+		body.append(str);
+
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.stringCount = strings.size();
+	header.recordCount = lines.size();
+	header.argumentCount = argumentCount;
+	header.stringDataSize = offset;
+	header.checksum = checksum(body.data(), body.size());
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if(!file.good()){
+		error = "could not open \"" + path + "\" for writing";
+		return false;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(body.data(), body.size());
+	if(!file.good()){
+		error = "could not write \"" + path + "\"";
+		return false;
+	}
+	return true;
+}
+
+bool compiledscript::read(const std::string &path, std::vector<std::string> &strings, std::vector<ScriptLine> &lines, std::string &error){
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		error = "could not open \"" + path + "\"";
+		return false;
+	}
+	struct stat info;
+	if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)){
+		close(fd);
+		error = "not a compiled script (too small)";
+		return false;
+	}
+	size_t size = info.st_size;
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED){
+		error = "could not map \"" + path + "\"";
+		return false;
+	}
+	const char *data = (const char*)mapped;
+
+	// Check everything before using any of it
+	Header header;
+	std::memcpy(&header, data, sizeof(header));
+	uint64_t expectedSize = sizeof(Header) + ((uint64_t)header.stringCount + 1) * sizeof(uint32_t) +
+			                (uint64_t)header.recordCount * sizeof(Record) + (uint64_t)header.argumentCount * sizeof(Argument) +
+							header.stringDataSize;
+	if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0){
+		error = "not a compiled script (bad magic)";
+	}else if(header.version < 1 || header.version > VERSION){
+		error = "compiled script version " + std::to_string(header.version) + " is not supported (expected " + std::to_string(VERSION) + " or older)";
+	}else if(expectedSize != size){
+		error = "compiled script is truncated or corrupt (wrong size)";
+	}else if(checksum(data + sizeof(Header), size - sizeof(Header)) != header.checksum){
+		error = "compiled script is corrupt (bad checksum)";
+	}
+	if(!error.empty()){
+		munmap(mapped, size);
+		return false;
+	}
+
+	// The sizes were checked against the file size above, so these can not overflow
+	const char *offsets = data + sizeof(Header);
+	const char *records = offsets + (size_t)((uint64_t)header.stringCount + 1) * sizeof(uint32_t);
+	const char *arguments = records + header.recordCount * sizeof(Record);
+	const char *stringData = arguments + header.argumentCount * sizeof(Argument);
+
+	strings.clear();
+	strings.reserve(header.stringCount);
+	for(uint32_t i = 0; i < header.stringCount; i++){
+		uint32_t start, end;
+		std::memcpy(&start, offsets + i * sizeof(uint32_t), sizeof(uint32_t));
+		std::memcpy(&end, offsets + (i + 1) * sizeof(uint32_t), sizeof(uint32_t));
+		if(start > end || end > header.stringDataSize){
+			error = "compiled script is corrupt (bad string table)";
+			munmap(mapped, size);
+			return false;
+		}
+		strings.push_back(std::string(stringData + start, end - start));
+	}
+
+	lines.clear();
+	lines.resize(header.recordCount);
+	for(uint32_t i = 0; i < header.recordCount; i++){
+		Record record;
+		std::memcpy(&record, records + i * sizeof(Record), sizeof(Record));
+		if((!isControlRecord(record.name) && record.name >= header.stringCount) ||
+				(uint64_t)record.firstArgument + record.argumentCount > header.argumentCount){
+			error = "compiled script is corrupt (bad record " + std::to_string(i) + ")";
+			munmap(mapped, size);
+			return false;
+		}
+
+		ScriptLine &line = lines[i];
+		line.name = record.name;
+		line.line = record.line;
+		line.arguments.reserve(record.argumentCount);
+		for(uint32_t j = 0; j < record.argumentCount; j++){
+			Argument argument;
+			std::memcpy(&argument, arguments + (record.firstArgument + j) * sizeof(Argument), sizeof(Argument));
+			// Values are checked before they are converted. A long int is 32 bits on the roboRIO and an enum index is an int.
+			bool valid = true;
+			switch((ArgumentType)argument.type){
+			case ArgumentType::Int:
+				valid = argument.intValue >= std::numeric_limits<long int>::min() && argument.intValue <= std::numeric_limits<long int>::max();
+				break;
+			case ArgumentType::Double:
+				valid = std::isfinite(argument.doubleValue); // The CSV parser never produces inf or nan
+				break;
+			case ArgumentType::Enum:
+				valid = argument.intValue >= 0 && argument.intValue <= std::numeric_limits<int>::max();
+				break;
+			default:
+				break;
+			}
+			if(!valid){
+				error = "compiled script is corrupt (bad argument value in record " + std::to_string(i) + ")";
+				munmap(mapped, size);
+				return false;
+			}
+			switch((ArgumentType)argument.type){
+			case ArgumentType::Int:
+				line.arguments.push_back(AutoArgument::fromInt(argument.intValue));
+				break;
+			case ArgumentType::Double:
+				line.arguments.push_back(AutoArgument::fromDouble(argument.doubleValue));
+				break;
+			case ArgumentType::Bool:
+				line.arguments.push_back(AutoArgument::fromBool(argument.intValue != 0));
+				break;
+			case ArgumentType::Enum:
+				line.arguments.push_back(AutoArgument::fromEnum((int)argument.intValue));
+				break;
+			default:
+				error = "compiled script is corrupt (bad argument type in record " + std::to_string(i) + ")";
+				munmap(mapped, size);
+				return false;
+			}
+		}
+	}
+
+	munmap(mapped, size);
+	return true;
+}
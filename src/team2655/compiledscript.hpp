@@ -0,0 +1,104 @@
+/**
+ * compiledscript.hpp
+ * Team 2655's binary (compiled) autonomous script format (.auto files)
+ * A compiled script holds already validated and parsed commands so loading it does not parse any text.
+ * Loading is not zero copy: read copies every record and argument out of the mapped file and AutoManager checks them
+ * again (argument types, enum ranges, nesting) the same way it checks a CSV script before anything runs.
+ * Create them with AutoManager::compileScript (or the autoc tool in tools/).
+ *
+ * Layout (all values little endian, the same on the roboRIO and x86 hosts):
+ *     Header
+ *     uint32_t stringOffsets[stringCount + 1]  Offsets into the string data (last one is the end)
+ *     Record records[recordCount]              One per script line (including END, DEFINE, CALL, and REPEAT lines)
+ *     Argument arguments[argumentCount]        The arguments of all records, in order
+ *     char stringData[]                        Command names
+ * The checksum covers everything after the header.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "autonomous.hpp"
+
+namespace team2655{
+namespace compiledscript{
+
+const char MAGIC[8] = { 'T', '2', '6', '5', '5', 'A', 'U', 'T' };
+const uint32_t VERSION = 2; // Version 1 files are still read (they have no DEFINE/CALL/REPEAT records)
+
+// Name indices of records that are not commands
+const uint32_t END_RECORD = 0xFFFFFFFF;    // Ends a group, DEFINE, or REPEAT
+const uint32_t DEFINE_RECORD = 0xFFFFFFFE; // Starts a subroutine. Argument: subroutine number (1 for the first DEFINE, 2 for the next...)
+const uint32_t CALL_RECORD = 0xFFFFFFFD;   // Runs a subroutine. Argument: subroutine number
+const uint32_t REPEAT_RECORD = 0xFFFFFFFC; // Runs the records up to the matching END. Argument: count
+
+/**
+ * Is a record's name one of the records above (not an index in the string table)
+ */
+inline bool isControlRecord(uint32_t name){
+	return name >= REPEAT_RECORD;
+}
+
+struct Header{
+	char magic[8];
+	uint32_t version;
+	uint32_t stringCount;
+	uint32_t recordCount;
+	uint32_t argumentCount;
+	uint32_t stringDataSize;
+	uint32_t checksum;
+};
+
+struct Record{
+	uint32_t name;          // Index in the string table (or a control record)
+	uint32_t line;          // Line in the original CSV (for error messages)
+	uint32_t firstArgument; // Index of the first argument in the argument table
+	uint32_t argumentCount;
+};
+
+struct Argument{
+	uint32_t type;   // ArgumentType
+	uint32_t unused;
+	int64_t intValue;
+	double doubleValue;
+};
+
+/**
+ * One line of a script (the same for CSV and compiled scripts)
+ */
+struct ScriptLine{
+	uint32_t name;  // Index in the string table (or a control record)
+	uint32_t line;
+	std::vector<AutoArgument> arguments;
+};
+
+/**
+ * Write a compiled script
+ * @param path Where to write the file
+ * @param strings The string table (command names)
+ * @param lines The script's lines
+ * @param error A description of the problem if writing fails
+ * @return Was the file written
+ */
+bool write(const std::string &path, const std::vector<std::string> &strings, const std::vector<ScriptLine> &lines, std::string &error);
+
+/**
+ * Read a compiled script. The file is mapped (mmap) and checked (size, version, checksum) before anything is used.
+ * Everything is copied into strings and lines (the mapping is closed before returning) and argument values are range
+ * checked (finite doubles, ints and enum indices that fit the types AutoArgument uses).
+ * @param path The file to read
+ * @param strings Where to put the string table
+ * @param lines Where to put the script's lines
+ * @param error A description of the problem if reading fails
+ * @return Was the file valid
+ */
+bool read(const std::string &path, std::vector<std::string> &strings, std::vector<ScriptLine> &lines, std::string &error);
+
+}
+}
@@ -0,0 +1,101 @@
+/**
+ * csvtokenizer.cpp
+ * See csvtokenizer.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "csvtokenizer.hpp"
+
+#include <cstring>
+
+using namespace team2655;
+
+////////////////////////////////////////////////////////////////////////
+/// StringRef
+////////////////////////////////////////////////////////////////////////
+
+StringRef::StringRef(const char *data, size_t length) : data(data), length(length){
+
+}
+
+StringRef::StringRef(const std::string &str) : data(str.data()), length(str.size()){
+
+}
+
+bool StringRef::empty() const{
+	return length == 0;
+}
+
+std::string StringRef::str() const{
+	return std::string(data, length);
+}
+
+bool StringRef::operator==(const StringRef &other) const{
+	return length == other.length && (length == 0 || std::memcmp(data, other.data, length) == 0);
+}
+
+bool StringRef::operator!=(const StringRef &other) const{
+	return !(*this == other);
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CSVTokenizer
+////////////////////////////////////////////////////////////////////////
+
+static inline bool isSpace(char c){
+	return c == ' ' || c == '\t';
+}
+
+CSVTokenizer::CSVTokenizer(const char *data, size_t length) : pos(data), end(data + length){
+
+}
+
+bool CSVTokenizer::nextLine(std::vector<StringRef> &columns){
+	while(pos < end){
+		columns.clear();
+		line++;
+
+		bool blank = true;
+		const char *columnStart = pos;
+
+		// Walk the line once. Each column ends at a comma or the end of the line.
+		while(true){
+			bool endOfLine = (pos >= end || *pos == '\n' || *pos == '\r');
+			if(endOfLine || *pos == ',') {
+				// Trim spaces and tabs on both sides of the column
+				const char *s = columnStart;
+				const char *e = pos;
+				while(s < e && isSpace(*s))
+					s++;
+				while(e > s && isSpace(*(e - 1)))
+					e--;
+				if(e != s)
+					blank = false;
+				columns.push_back(StringRef(s, e - s));
+
+				if(endOfLine)
+					break;
+				columnStart = pos + 1;
+			}
+			pos++;
+		}
+
+		// Skip the line ending (\r\n counts as one)
+		if(pos < end){
+			if(*pos == '\r' && pos + 1 < end && *(pos + 1) == '\n')
+				pos++;
+			pos++;
+		}
+
+		if(!blank)
+			return true;
+	}
+	columns.clear();
+	return false;
+}
+
+int CSVTokenizer::getLineNumber() const{
+	return line;
+}
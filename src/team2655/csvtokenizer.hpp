@@ -0,0 +1,72 @@
+/**
+ * csvtokenizer.hpp
+ * A single pass tokenizer for Team 2655's CSV autonomous scripts
+ * Columns are returned as references into the script text. Nothing is copied.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace team2655{
+
+/**
+ * A reference to a piece of a string that is stored somewhere else (the text is not copied)
+ */
+struct StringRef{
+	const char *data = nullptr;
+	size_t length = 0;
+
+	StringRef() = default;
+	StringRef(const char *data, size_t length);
+	StringRef(const std::string &str);
+
+	bool empty() const;
+
+	/**
+	 * Copy the referenced text into a new string
+	 */
+	std::string str() const;
+
+	bool operator==(const StringRef &other) const;
+	bool operator!=(const StringRef &other) const;
+};
+
+/**
+ * Splits CSV script text into lines and columns in one pass.
+ *   - Line endings can be \n, \r\n, or \r
+ *   - Spaces and tabs around each column are trimmed
+ *   - Blank lines (only whitespace) are skipped
+ */
+class CSVTokenizer{
+private:
+	const char *pos;
+	const char *end;
+	int line = 0;
+
+public:
+	/**
+	 * @param data The script text. Must stay valid while the tokenizer and any returned columns are used.
+	 * @param length The length of the script text
+	 */
+	CSVTokenizer(const char *data, size_t length);
+
+	/**
+	 * Get the columns of the next non-blank line
+	 * @param columns Where to store the columns. Cleared first. Reusing the same vector avoids allocation.
+	 * @return false if there are no more lines
+	 */
+	bool nextLine(std::vector<StringRef> &columns);
+
+	/**
+	 * Get the (1 based) line number of the last line returned by nextLine
+	 */
+	int getLineNumber() const;
+};
+
+}
@@ -0,0 +1,149 @@
+/**
+ * executor.cpp
+ * See executor.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "executor.hpp"
+
+#include <cerrno>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+using namespace team2655;
+
+static int64_t toNanos(const struct timespec &t){
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static struct timespec fromNanos(int64_t ns){
+	struct timespec t;
+	t.tv_sec = ns / 1000000000;
+	t.tv_nsec = ns % 1000000000;
+	return t;
+}
+
+static int64_t monotonicNanos(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return toNanos(now);
+}
+
+AutoExecutor::AutoExecutor(AutoManager &manager, double rateHz, int priority) : manager(manager), periodNs(0), priority(priority){
+	// A rate of 0 or less (or so small the period does not fit in nanoseconds) is reported by start
+	double period = 1e9 / rateHz;
+	if(rateHz > 0 && period >= 1 && period <= 1e18)
+		periodNs = (int64_t)period;
+}
+
+bool AutoExecutor::start(){
+	if(running)
+		return false;
+	if(periodNs <= 0){
+		std::cerr << "AutoExecutor: the rate must be more than 0 times per second" << std::endl;
+		return false;
+	}
+	if(thread.joinable())
+		thread.join(); // Finished on its own last time
+
+	finished = false;
+	realtime = false;
+	commandIndex = -1;
+	ticks = 0;
+	missedDeadlines = 0;
+	lastTickNs = 0;
+	worstTickNs = 0;
+
+	running = true;
+	// Tell the manager which thread is processing before that thread can tick, so a killAuto right after start
+	// is always handed to it (run waits for the lock)
+	std::lock_guard<std::mutex> lock(startMutex);
+	thread = std::thread(&AutoExecutor::run, this);
+	manager.setProcessingThread(thread.get_id());
+	return true;
+}
+
+void AutoExecutor::stop(){
+	running = false;
+	if(thread.joinable())
+		thread.join();
+}
+
+void AutoExecutor::kill(){
+	// Handed to the executor thread if it is running (process returns false after so the thread finishes)
+	manager.killAuto();
+	stop();
+}
+
+bool AutoExecutor::isRunning() const{
+	return running;
+}
+
+ExecutorStatus AutoExecutor::getStatus() const{
+	ExecutorStatus status;
+	status.running = running;
+	status.finished = finished;
+	status.realtime = realtime;
+	status.commandIndex = commandIndex;
+	status.ticks = ticks;
+	status.missedDeadlines = missedDeadlines;
+	status.lastTickNs = lastTickNs;
+	status.worstTickNs = worstTickNs;
+	return status;
+}
+
+void AutoExecutor::run(){
+	// Real time priority needs permission (rtprio). Keep running without it if it is not allowed.
+	struct sched_param param;
+	param.sched_priority = priority;
+	if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0){
+		realtime = true;
+	}else{
+		std::cerr << "AutoExecutor: could not set SCHED_FIFO priority " << priority << ". Running with normal priority." << std::endl;
+	}
+
+	// Wait for start to give the manager this thread's id
+	{
+		std::lock_guard<std::mutex> lock(startMutex);
+	}
+
+	int64_t next = monotonicNanos();
+	while(running){
+		int64_t begin = monotonicNanos();
+		bool more = manager.process();
+		int64_t end = monotonicNanos();
+
+		lastTickNs.store(end - begin, std::memory_order_relaxed);
+		if(end - begin > worstTickNs.load(std::memory_order_relaxed))
+			worstTickNs.store(end - begin, std::memory_order_relaxed);
+		commandIndex.store(manager.getCurrentCommandIndex(), std::memory_order_relaxed);
+		ticks.fetch_add(1, std::memory_order_relaxed);
+
+		if(!more){
+			finished = true;
+			break;
+		}
+
+		// Sleep until the next absolute deadline. If this tick ran past it skip the missed periods instead of catching up.
+		next += periodNs;
+		if(end > next){
+			missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+			while(next < end)
+				next += periodNs;
+		}
+		struct timespec deadline = fromNanos(next);
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR);
+	}
+
+	manager.setProcessingThread(std::thread::id());
+	running = false;
+}
+
+AutoExecutor::~AutoExecutor(){
+	stop();
+}
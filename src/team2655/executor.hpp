@@ -0,0 +1,100 @@
+/**
+ * executor.hpp
+ * Runs an AutoManager on its own real time thread at a fixed rate (faster than the IterativeRobot loop)
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "autonomous.hpp"
+
+namespace team2655{
+
+/**
+ * A snapshot of what the executor thread is doing
+ */
+struct ExecutorStatus{
+	bool running;             // Is the thread running
+	bool finished;            // Has the script finished (the thread stops when it does)
+	bool realtime;            // Did the thread get SCHED_FIFO priority (needs permission)
+	int commandIndex;         // Index of the running command
+	uint64_t ticks;           // Number of ticks run
+	uint64_t missedDeadlines; // Ticks that ended after the next tick should have started
+	int64_t lastTickNs;       // How long the last tick took
+	int64_t worstTickNs;      // Longest tick
+};
+
+/**
+ * Calls AutoManager::process on a SCHED_FIFO thread at a fixed rate using absolute deadlines (clock_nanosleep),
+ * so the timing does not drift and is not limited to the 20ms IterativeRobot period.
+ *
+ * While the executor is running the main thread should only use it through this class (getStatus, kill, stop).
+ * AutoManager::killAuto is also safe to call from the main thread (it is handed to the executor thread).
+ * Stop the executor before loading, selecting, or changing scripts.
+ */
+class AutoExecutor{
+private:
+	AutoManager &manager;
+	int64_t periodNs; // 0 if the rate given was not usable (start fails)
+	int priority;
+
+	std::thread thread;
+	std::atomic<bool> running{false};
+	std::mutex startMutex; // Held by start until the manager knows the thread's id (the thread waits for it)
+
+	// Status written by the executor thread, read by anyone
+	std::atomic<bool> finished{false};
+	std::atomic<bool> realtime{false};
+	std::atomic<int> commandIndex{-1};
+	std::atomic<uint64_t> ticks{0};
+	std::atomic<uint64_t> missedDeadlines{0};
+	std::atomic<int64_t> lastTickNs{0};
+	std::atomic<int64_t> worstTickNs{0};
+
+	void run();
+
+public:
+	/**
+	 * @param manager The AutoManager to run. Must outlive the executor.
+	 * @param rateHz How many times per second to call process (must be more than 0)
+	 * @param priority SCHED_FIFO priority for the thread (1-99)
+	 */
+	AutoExecutor(AutoManager &manager, double rateHz = 200, int priority = 40);
+	AutoExecutor(const AutoExecutor&) = delete;
+	AutoExecutor& operator=(const AutoExecutor&) = delete;
+
+	/**
+	 * Start running the manager's current script on the executor thread
+	 * @return Was the thread started (false if it is already running or the rate is not more than 0)
+	 */
+	bool start();
+
+	/**
+	 * Stop the thread after its current tick. The current command is not completed (see kill).
+	 */
+	void stop();
+
+	/**
+	 * Complete the current command (on the executor thread, between ticks) then stop the thread.
+	 * Call this when the robot leaves autonomous. Safe to call if the executor is not running.
+	 */
+	void kill();
+
+	bool isRunning() const;
+
+	/**
+	 * Get what the executor is doing. Lock free, safe from any thread.
+	 */
+	ExecutorStatus getStatus() const;
+
+	~AutoExecutor();
+};
+
+}
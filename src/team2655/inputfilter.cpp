@@ -0,0 +1,117 @@
+/**
+ * inputfilter.cpp
+ * See inputfilter.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "inputfilter.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace team2655;
+
+const int ControllerSnapshot::MAX_AXES;
+const int ControllerSnapshot::MAX_BUTTONS;
+const int ControllerSnapshot::MAX_POVS;
+const int InputSnapshot::MAX_CONTROLLERS;
+
+bool InputFilter::addStage(FilterType type, int controller, int index, double parameter, const jshelper::AxisShaper &shaper){
+	bool button = type == FilterType::Debounce;
+	if(controller < 0 || controller >= InputSnapshot::MAX_CONTROLLERS){
+		std::cerr << "InputFilterError: there is no controller " << controller << std::endl;
+		return false;
+	}
+	if(button ? (index < 1 || index > ControllerSnapshot::MAX_BUTTONS) : (index < 0 || index >= ControllerSnapshot::MAX_AXES)){
+		std::cerr << "InputFilterError: there is no " << (button ? "button " : "axis ") << index << std::endl;
+		return false;
+	}
+	if(type != FilterType::Curve && !(parameter > 0)){
+		std::cerr << "InputFilterError: filter parameters must be above 0 (got " << parameter << ")" << std::endl;
+		return false;
+	}
+	stages.push_back({ type, controller, index, parameter, shaper, 0, 0, false });
+	return true;
+}
+
+bool InputFilter::addCurve(int controller, int axis, const jshelper::AxisConfig &config, bool deadbandOnly){
+	return addStage(FilterType::Curve, controller, axis, 0, jshelper::AxisShaper(config, deadbandOnly));
+}
+
+bool InputFilter::addSlewRate(int controller, int axis, double maxPerSecond){
+	return addStage(FilterType::SlewRate, controller, axis, maxPerSecond, jshelper::AxisShaper());
+}
+
+bool InputFilter::addLowPass(int controller, int axis, double timeConstant){
+	return addStage(FilterType::LowPass, controller, axis, timeConstant, jshelper::AxisShaper());
+}
+
+bool InputFilter::addDebounce(int controller, int button, double seconds){
+	return addStage(FilterType::Debounce, controller, button, seconds, jshelper::AxisShaper());
+}
+
+void InputFilter::clear(){
+	stages.clear();
+	hasLast = false;
+}
+
+void InputFilter::reset(){
+	hasLast = false;
+}
+
+void InputFilter::apply(const InputSnapshot &raw, InputSnapshot &filtered){
+	filtered = raw;
+
+	// Stages with state pass the first snapshot through (there is nothing to limit or smooth against yet)
+	bool first = !hasLast;
+	double dt = first ? 0 : (raw.timeMicros - lastMicros) / 1e6;
+	lastMicros = raw.timeMicros;
+	hasLast = true;
+
+	for(Stage &stage : stages){
+		ControllerSnapshot &controller = filtered.controllers[stage.controller];
+
+		switch(stage.type){
+		case FilterType::Curve:{
+			double &axis = controller.axes[stage.index];
+			axis = stage.shaper.shape(axis);
+			break;
+		}
+		case FilterType::SlewRate:{
+			double &axis = controller.axes[stage.index];
+			if(!first){
+				double step = stage.parameter * dt;
+				axis = stage.value + std::max(-step, std::min(step, axis - stage.value));
+			}
+			stage.value = axis;
+			break;
+		}
+		case FilterType::LowPass:{
+			double &axis = controller.axes[stage.index];
+			if(!first)
+				axis = stage.value + (axis - stage.value) * dt / (stage.parameter + dt);
+			stage.value = axis;
+			break;
+		}
+		case FilterType::Debounce:{
+			uint32_t bit = 1u << (stage.index - 1);
+			bool pressed = (controller.buttons & bit) != 0;
+			if(first || pressed == (stage.value != 0)){
+				stage.value = pressed;
+				stage.pending = false;
+			}else if(!stage.pending){
+				stage.pending = true;
+				stage.changeMicros = raw.timeMicros;
+			}
+			if(stage.pending && raw.timeMicros - stage.changeMicros >= stage.parameter * 1e6){
+				stage.value = pressed;
+				stage.pending = false;
+			}
+			controller.buttons = (stage.value != 0) ? (controller.buttons | bit) : (controller.buttons & ~bit);
+			break;
+		}
+		}
+	}
+}
@@ -0,0 +1,142 @@
+/**
+ * inputfilter.hpp
+ * Team 2655's controller input snapshot and filter chain
+ * Every controller is read once per loop into an InputSnapshot (see OI::update). An InputFilter then runs a chain of
+ * stages (axis curve, slew rate limit, low pass, button debounce) over the whole snapshot in one pass. Code that needs
+ * input reads the filtered snapshot instead of the joysticks, so every reader in a loop sees the same values.
+ * Nothing here uses WPILib, so filters can be run (and benchmarked) on a host.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "joystick.hpp"
+
+namespace team2655{
+
+/**
+ * Everything read from one controller in one loop
+ */
+struct ControllerSnapshot{
+	static const int MAX_AXES = jshelper::ControllerShaper::MAX_AXES;
+	static const int MAX_BUTTONS = 32;
+	static const int MAX_POVS = 12;
+
+	double axes[MAX_AXES] = {};
+	uint32_t buttons = 0;     // Bit n - 1 is button n (buttons are numbered from 1, same as GetRawButton)
+	int povs[MAX_POVS] = {};  // Angle in degrees or -1 if not pressed (same as GetPOV)
+	int axisCount = 0;
+	int buttonCount = 0;
+	int povCount = 0;
+
+	/**
+	 * Is a button pressed
+	 * @param button The button number (from 1, same as GetRawButton)
+	 */
+	bool getButton(int button) const{
+		return button >= 1 && button <= MAX_BUTTONS && ((buttons >> (button - 1)) & 1);
+	}
+};
+
+/**
+ * Everything read from every controller in one loop. Plain data (no pointers) so it can be copied as a whole.
+ */
+struct InputSnapshot{
+	static const int MAX_CONTROLLERS = 6; // The most controllers the driver station sends
+
+	int64_t timeMicros = 0; // When it was read (telemetry::nowMicros clock)
+	int controllerCount = 0;
+	ControllerSnapshot controllers[MAX_CONTROLLERS];
+};
+
+enum class FilterType{
+	Curve,     // Deadband and curve from an AxisConfig
+	SlewRate,  // Limit how fast an axis can change (units per second)
+	LowPass,   // One pole low pass (time constant in seconds)
+	Debounce   // A button only changes after it has been in the new state for some time (seconds)
+};
+
+/**
+ * Runs a chain of filter stages over input snapshots. Stages run in the order they were added, so an axis can be curved
+ * then slew rate limited (for example). Adding stages allocates. Applying them does not.
+ * Usage (setup):
+ *     filter.addCurve(0, 1, config);
+ *     filter.addSlewRate(0, 1, 4);
+ * Usage (every loop):
+ *     filter.apply(raw, filtered);
+ */
+class InputFilter{
+private:
+	struct Stage{
+		FilterType type;
+		int controller;
+		int index;                // Axis (from 0) or button (from 1)
+		double parameter;         // Rate, time constant or debounce time
+		jshelper::AxisShaper shaper;
+
+		double value;             // Last output (axes) or current state (buttons)
+		int64_t changeMicros;     // When a debounced button started to differ from its state
+		bool pending;             // Is a debounced button different from its state
+	};
+
+	std::vector<Stage> stages;
+	int64_t lastMicros = 0;
+	bool hasLast = false;
+
+	bool addStage(FilterType type, int controller, int index, double parameter, const jshelper::AxisShaper &shaper);
+
+public:
+	/**
+	 * Shape an axis with a deadband and curve
+	 * @param controller The controller (driver station port)
+	 * @param axis The axis (from 0, same as GetRawAxis)
+	 * @param config The curve (from createAxisConfig)
+	 * @param deadbandOnly Only apply the deadband (same as getAxisValue)
+	 * @return Was the stage added (false if the controller or axis is out of range)
+	 */
+	bool addCurve(int controller, int axis, const jshelper::AxisConfig &config, bool deadbandOnly = false);
+
+	/**
+	 * Limit how fast an axis can change (ex. so the robot does not tip when the driver slams the stick)
+	 * @param maxPerSecond The largest change per second (above 0)
+	 */
+	bool addSlewRate(int controller, int axis, double maxPerSecond);
+
+	/**
+	 * Smooth an axis with a one pole low pass filter
+	 * @param timeConstant Seconds to get about 63% of the way to a new value (above 0)
+	 */
+	bool addLowPass(int controller, int axis, double timeConstant);
+
+	/**
+	 * Ignore button changes shorter than a time (ex. a worn button that flickers)
+	 * @param button The button (from 1, same as GetRawButton)
+	 * @param seconds How long the button must be in a new state before it changes (above 0)
+	 */
+	bool addDebounce(int controller, int button, double seconds);
+
+	/**
+	 * Remove every stage
+	 */
+	void clear();
+
+	/**
+	 * Forget the state of every stage (ex. when teleop starts so the slew rate does not start from an old value).
+	 * The next snapshot is passed through the rate limits, low pass filters and debounces as is.
+	 */
+	void reset();
+
+	/**
+	 * Filter a snapshot. Does not allocate.
+	 * @param raw The snapshot read from the controllers
+	 * @param filtered Where to put the filtered snapshot (can not be the same as raw)
+	 */
+	void apply(const InputSnapshot &raw, InputSnapshot &filtered);
+};
+
+}
@@ -1,5 +1,8 @@
 #include "joystick.hpp"
 
+#include <cstdint>
+#include <cstring>
+
 /// Adapted from the gist https://gist.github.com/chrisengelsma/108f7ab0a746323beaaf7d6634cf4add
 template <class TYPE>
 bool team2655::jshelper::polyfit(const std::vector<TYPE> & x, const std::vector<TYPE> & y, const int &order, std::vector<TYPE> &coeffs) {
@@ -19,7 +22,6 @@ bool team2655::jshelper::polyfit(const std::vector<TYPE> & x, const std::vector<
 	int np1 = n + 1;
 	int np2 = n + 2;
 	int tnp1 = 2 * n + 1;
-	TYPE tmp;
 
 	// X = vector that stores values of sigma(xi^2n)
 	std::vector<TYPE> X(tnp1);
@@ -55,24 +57,21 @@ bool team2655::jshelper::polyfit(const std::vector<TYPE> & x, const std::vector<
 	n += 1;
 	int nm1 = n-1;
 
-	// Pivotisation of the B matrix.
-	for (int i = 0; i < n; ++i)
-		for (int k = i+1; k < n; ++k)
-			if (B[i][i] < B[k][i])
-				for (int j = 0; j <= n; ++j) {
-					tmp = B[i][j];
-					B[i][j] = B[k][j];
-					B[k][j] = tmp;
-				}
-
 	// Performs the Gaussian elimination.
-	// (1) Make all elements below the pivot equals to zero
+	// (1) Move the row with the largest absolute value in this column to the pivot (partial pivoting)
+	// (2) Make all elements below the pivot equals to zero
 	//     or eliminate the variable.
-	for (int i=0; i<nm1; ++i)
+	for (int i=0; i<nm1; ++i) {
+		int pivot = i;
+		for (int k = i+1; k < n; ++k)
+			if (std::fabs(B[k][i]) > std::fabs(B[pivot][i]))
+				pivot = k;
+		std::swap(B[i], B[pivot]);            // (1)
 		for (int k =i+1; k<n; ++k) {
 			TYPE t = B[k][i] / B[i][i];
 			for (int j=0; j<=n; ++j)
-				B[k][j] -= t*B[i][j];         // (1)
+				B[k][j] -= t*B[i][j];         // (2)
+		}
 	}
 
 	// Back substitution.
@@ -87,47 +86,108 @@ bool team2655::jshelper::polyfit(const std::vector<TYPE> & x, const std::vector<
 		a[i] /= B[i][i];                  // (3)
 	}
 
-	coeffs.resize(a.size());
-	for (size_t i = 0; i < a.size(); ++i)
-		coeffs.insert(coeffs.begin() + i, a[i]);
+	coeffs.assign(a.begin(), a.end());
 
 	return true;
 }
 
-team2655::jshelper::AxisConfig team2655::jshelper::createAxisConfig(double deadband, double minPower, double midPower){
-
-	// NO NEGATIVE VALUES!!! The regression is generated for the 1st quadrant. If the input is negative the output will be negated.
-	deadband = fabs(deadband);
-	minPower = fabs(minPower);
-	midPower = fabs(midPower);
+// polyfit is defined here (not in the header) so instantiate the types that can be used from other files
+template bool team2655::jshelper::polyfit<double>(const std::vector<double> &, const std::vector<double> &, const int &, std::vector<double> &);
 
-	double midDeadband = (1 - deadband) / 2 + deadband; // Middle of deadband and 1
+// Convert coefficients for powers of u = (x - center) / halfRange to coefficients for powers of x.
+// Horner's method on the polynomials: result = result * (x - center) / halfRange + a[k]
+template <int ORDER>
+static void toPowersOfX(const std::array<double, ORDER + 1> &a, double center, double halfRange, std::array<double, ORDER + 1> &coeffs){
+	coeffs.fill(0);
+	coeffs[0] = a[ORDER];
+	for(int k = ORDER - 1; k >= 0; k--){
+		for(int j = ORDER; j > 0; j--)
+			coeffs[j] = (coeffs[j - 1] - coeffs[j] * center) / halfRange;
+		coeffs[0] = -coeffs[0] * center / halfRange + a[k];
+	}
+}
 
-	// The smallest x with a non-zero value, the middle position, the middle position + a tiny bit (so flat part of cubic is here), the max x value (1)
-	std::vector<double> xCoords = { deadband, midDeadband, midDeadband + 0.01, 1 };
+template <int ORDER>
+bool team2655::jshelper::solvePowerSums(const PowerSums<ORDER> &sums, std::array<double, ORDER + 1> &coeffs){
+	const int N = ORDER + 1;
 
-	// The minimum value, The mid power, the mid power (for the flat part), the max y value (1)
-	std::vector<double> yCoords = {minPower, midPower, midPower, 1};
+	// The normal equations (augmented with the x^k * y sums)
+	std::array<std::array<double, N + 1>, N> B;
+	for(int i = 0; i < N; i++){
+		for(int j = 0; j < N; j++)
+			B[i][j] = sums.x[i + j];
+		B[i][N] = sums.xy[i];
+	}
 
-	std::array<double, 5> coefficients;
-	std::vector<double> results;
+	// Elimination with partial pivoting (the row with the largest absolute value in each column is used)
+	for(int i = 0; i < N; i++){
+		int pivot = i;
+		for(int k = i + 1; k < N; k++){
+			if(std::fabs(B[k][i]) > std::fabs(B[pivot][i]))
+				pivot = k;
+		}
+		// The matrix is positive definite when there are enough different x values, so a pivot this small means there are not
+		if(!(std::fabs(B[pivot][i]) > 1e-12 * sums.x[0]))
+			return false;
+		std::swap(B[i], B[pivot]);
+		for(int k = i + 1; k < N; k++){
+			double t = B[k][i] / B[i][i];
+			for(int j = i; j <= N; j++)
+				B[k][j] -= t * B[i][j];
+		}
+	}
 
-	// Get the coordinates
-	if(polyfit<double>(xCoords, yCoords, 3, results)){
-		std::copy_n(results.begin(), 4, coefficients.begin());
-		coefficients[4] = deadband;
-	}else{
-		// If generating the regression fails: default to a linear function that will only apply the jshelper deadband.
-		createAxisConfig(deadband);
+	// Back substitution
+	for(int i = N - 1; i >= 0; i--){
+		double value = B[i][N];
+		for(int j = i + 1; j < N; j++)
+			value -= B[i][j] * coeffs[j];
+		coeffs[i] = value / B[i][i];
 	}
-	return coefficients; // This is in the order {d, c, b, a, deadband} where f(x)=ax^3+bx^2+cx+d with x as the joystick input
+	return true;
 }
 
-team2655::jshelper::AxisConfig team2655::jshelper::createAxisConfig(double deadband){
-	deadband = fabs(deadband);
-	return std::array<double, 5>{ 0, 1, 0, 0, deadband }; // This is in the order {d, c, b, a, deadband} where f(x)=ax^3+bx^2+cx+d with x as the joystick input
+template <int ORDER>
+bool team2655::jshelper::polyfit(const double *x, const double *y, size_t count, std::array<double, ORDER + 1> &coeffs){
+	if(count < ORDER + 1)
+		return false;
+
+	// Fit in terms of u = (x - center) / halfRange (-1 to 1). Powers of points bunched together (ex. 0.99 to 1) are almost
+	// the same, which makes the equations nearly singular. Spread out they are not.
+	double minX = x[0], maxX = x[0];
+	for(size_t i = 1; i < count; i++){
+		minX = std::min(minX, x[i]);
+		maxX = std::max(maxX, x[i]);
+	}
+	double center = (minX + maxX) / 2;
+	double halfRange = (maxX - minX) / 2;
+	if(!(halfRange > 0))
+		return false; // Every x is the same (or NaN)
+
+	PowerSums<ORDER> sums;
+	for(size_t i = 0; i < count; i++)
+		sums.add((x[i] - center) / halfRange, y[i]);
+
+	std::array<double, ORDER + 1> a;
+	if(!solvePowerSums<ORDER>(sums, a))
+		return false;
+
+	toPowersOfX<ORDER>(a, center, halfRange, coeffs);
+	return true;
 }
 
+// The fixed order versions are defined here too, so instantiate the orders that can be used from other files
+template bool team2655::jshelper::solvePowerSums<1>(const PowerSums<1> &, std::array<double, 2> &);
+template bool team2655::jshelper::solvePowerSums<2>(const PowerSums<2> &, std::array<double, 3> &);
+template bool team2655::jshelper::solvePowerSums<3>(const PowerSums<3> &, std::array<double, 4> &);
+template bool team2655::jshelper::solvePowerSums<4>(const PowerSums<4> &, std::array<double, 5> &);
+template bool team2655::jshelper::solvePowerSums<5>(const PowerSums<5> &, std::array<double, 6> &);
+template bool team2655::jshelper::polyfit<1>(const double *, const double *, size_t, std::array<double, 2> &);
+template bool team2655::jshelper::polyfit<2>(const double *, const double *, size_t, std::array<double, 3> &);
+template bool team2655::jshelper::polyfit<3>(const double *, const double *, size_t, std::array<double, 4> &);
+template bool team2655::jshelper::polyfit<4>(const double *, const double *, size_t, std::array<double, 5> &);
+template bool team2655::jshelper::polyfit<5>(const double *, const double *, size_t, std::array<double, 6> &);
+
 double team2655::jshelper::getAxisValue(const team2655::jshelper::AxisConfig config, const double axisValue, bool deadbandOnly){
 
 	// Adhere to the set deadband
@@ -156,3 +216,272 @@ double team2655::jshelper::getAxisValue(const team2655::jshelper::AxisConfig con
 	}
 }
 
+
+////////////////////////////////////////////////////////////////////////
+/// AxisShaper / ControllerShaper batch shaping
+////////////////////////////////////////////////////////////////////////
+
+// 2 values at once (GCC vector extensions). 16 bytes is one SSE2 register, which every x86-64 host has. Targets without
+// double precision SIMD (ex. the roboRIO's NEON) get the same operations done one value at a time, which is still branch free.
+typedef double Doublex2 __attribute__((vector_size(16)));
+typedef int64_t Int64x2 __attribute__((vector_size(16)));
+
+static const int64_t SIGN_BIT = INT64_MIN;
+
+// Same as AxisShaper::shape for 2 values: copysign(|p(|x|)|, x) or 0 if |x| is inside the deadband.
+// Vectors are passed by reference (passing them by value changes with the instruction set, which GCC warns about).
+static inline void shapex2(Doublex2 &values, const Doublex2 &c0, const Doublex2 &c1, const Doublex2 &c2, const Doublex2 &c3,
+		                   const Doublex2 &deadband){
+	Int64x2 bits = (Int64x2)values;
+	Int64x2 sign = bits & SIGN_BIT;
+	Doublex2 x = (Doublex2)(bits & ~SIGN_BIT);
+	Doublex2 p = ((c3 * x + c2) * x + c1) * x + c0;
+	Int64x2 inDeadband = (x < deadband); // All bits set where true
+	values = (Doublex2)((((Int64x2)p & ~SIGN_BIT) | sign) & ~inDeadband);
+}
+
+void team2655::jshelper::AxisShaper::shape(const double *in, double *out, size_t count) const{
+	const Doublex2 a0 = { c0, c0 }, a1 = { c1, c1 }, a2 = { c2, c2 }, a3 = { c3, c3 };
+	const Doublex2 db = { deadband, deadband };
+	size_t i = 0;
+	for(; i + 2 <= count; i += 2){
+		Doublex2 values;
+		std::memcpy(&values, in + i, sizeof(values)); // in and out do not need to be aligned
+		shapex2(values, a0, a1, a2, a3, db);
+		std::memcpy(out + i, &values, sizeof(values));
+	}
+	for(; i < count; i++)
+		out[i] = shape(in[i]);
+}
+
+const int team2655::jshelper::ControllerShaper::MAX_AXES;
+
+team2655::jshelper::ControllerShaper::ControllerShaper(){
+	AxisShaper passThrough;
+	for(int i = 0; i < MAX_AXES; i++)
+		setAxis(i, passThrough);
+}
+
+bool team2655::jshelper::ControllerShaper::setAxis(int axis, const AxisShaper &shaper){
+	if(axis < 0 || axis >= MAX_AXES)
+		return false;
+	c0[axis] = shaper.c0;
+	c1[axis] = shaper.c1;
+	c2[axis] = shaper.c2;
+	c3[axis] = shaper.c3;
+	deadband[axis] = shaper.deadband;
+	return true;
+}
+
+void team2655::jshelper::ControllerShaper::shape(const double *in, double *out, int axisCount) const{
+	if(axisCount > MAX_AXES)
+		axisCount = MAX_AXES;
+
+	// Each pair of axes loads its own coefficients (stored by coefficient so they are next to each other)
+	int i = 0;
+	for(; i + 2 <= axisCount; i += 2){
+		Doublex2 values, a0, a1, a2, a3, db;
+		std::memcpy(&values, in + i, sizeof(values));
+		std::memcpy(&a0, c0 + i, sizeof(a0));
+		std::memcpy(&a1, c1 + i, sizeof(a1));
+		std::memcpy(&a2, c2 + i, sizeof(a2));
+		std::memcpy(&a3, c3 + i, sizeof(a3));
+		std::memcpy(&db, deadband + i, sizeof(db));
+		shapex2(values, a0, a1, a2, a3, db);
+		std::memcpy(out + i, &values, sizeof(values));
+	}
+	for(; i < axisCount; i++){
+		double x = std::fabs(in[i]);
+		double result = std::copysign(std::fabs(((c3[i] * x + c2[i]) * x + c1[i]) * x + c0[i]), in[i]);
+		out[i] = (x < deadband[i]) ? 0 : result;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////
+/// AxisCurve
+////////////////////////////////////////////////////////////////////////
+
+const size_t team2655::jshelper::AxisCurve::DEFAULT_RESOLUTION;
+
+team2655::jshelper::AxisCurve::AxisCurve() : table{ { 0, 1 }, { 1, 0 } }{
+
+}
+
+team2655::jshelper::AxisCurve::AxisCurve(const std::function<double(double)> &shape, double deadband, size_t resolution){
+	if(resolution < 1)
+		resolution = 1;
+	this->deadband = std::fabs(deadband);
+
+	// No room for a curve. Every value is inside the deadband (or exactly at 1).
+	if(this->deadband >= 1){
+		table.assign(2, Segment{ 0, 0 });
+		indexScale = 0;
+		maxPosition = 1;
+		return;
+	}
+
+	double width = 1 - this->deadband;
+	std::vector<double> values(resolution + 1);
+	for(size_t i = 0; i <= resolution; i++){
+		// The last one is exactly 1 (not the sum of rounded steps)
+		double x = (i == resolution) ? 1 : this->deadband + width * i / resolution;
+		values[i] = std::fabs(shape(x));
+	}
+
+	table.resize(resolution + 1);
+	for(size_t i = 0; i < resolution; i++)
+		table[i] = Segment{ values[i], values[i + 1] - values[i] };
+	table[resolution] = Segment{ values[resolution], 0 };
+	indexScale = resolution / width;
+	maxPosition = resolution;
+}
+
+team2655::jshelper::AxisCurve team2655::jshelper::AxisCurve::fromConfig(const AxisConfig &config, size_t resolution){
+	return AxisCurve([&config](double x){ return getAxisValue(config, x); }, config[4], resolution);
+}
+
+team2655::jshelper::AxisCurve team2655::jshelper::AxisCurve::exponential(double deadband, double exponent, size_t resolution){
+	double width = 1 - std::fabs(deadband);
+	double total = std::expm1(exponent);
+	return AxisCurve([=](double x){
+		double t = (x - std::fabs(deadband)) / width;
+		return (total == 0) ? t : std::expm1(exponent * t) / total; // expm1 keeps small exponents accurate
+	}, deadband, resolution);
+}
+
+// Sort the points by x and make sure they can define a curve
+static void checkPoints(std::vector<team2655::jshelper::AxisCurve::Point> &points){
+	typedef team2655::jshelper::AxisCurve::Point Point;
+	if(points.size() < 2)
+		throw std::runtime_error("A curve needs at least 2 points!");
+	std::sort(points.begin(), points.end(), [](const Point &a, const Point &b){ return a.x < b.x; });
+	for(size_t i = 1; i < points.size(); i++){
+		if(!(points[i].x > points[i - 1].x))
+			throw std::runtime_error("Curve points must have different x values!");
+	}
+}
+
+// The segment (between points i and i + 1) that contains x. Points are sorted and x is inside them.
+static size_t findSegment(const std::vector<team2655::jshelper::AxisCurve::Point> &points, double x){
+	size_t i = 0;
+	while(i + 2 < points.size() && x >= points[i + 1].x)
+		i++;
+	return i;
+}
+
+team2655::jshelper::AxisCurve team2655::jshelper::AxisCurve::piecewiseLinear(std::vector<Point> points, double deadband, size_t resolution){
+	checkPoints(points);
+	return AxisCurve([&points](double x){
+		if(x <= points.front().x)
+			return points.front().y;
+		if(x >= points.back().x)
+			return points.back().y;
+		size_t i = findSegment(points, x);
+		double t = (x - points[i].x) / (points[i + 1].x - points[i].x);
+		return points[i].y + t * (points[i + 1].y - points[i].y);
+	}, deadband, resolution);
+}
+
+team2655::jshelper::AxisCurve team2655::jshelper::AxisCurve::spline(std::vector<Point> points, double deadband, size_t resolution){
+	checkPoints(points);
+
+	// Monotone cubic Hermite spline (Fritsch-Carlson). Start with the slope between each pair of points.
+	size_t n = points.size();
+	std::vector<double> secants(n - 1), tangents(n);
+	for(size_t i = 0; i + 1 < n; i++)
+		secants[i] = (points[i + 1].y - points[i].y) / (points[i + 1].x - points[i].x);
+
+	// Average the slopes on each side of a point. Flat where the direction changes (that point is a peak or valley).
+	tangents[0] = secants[0];
+	tangents[n - 1] = secants[n - 2];
+	for(size_t i = 1; i + 1 < n; i++)
+		tangents[i] = (secants[i - 1] * secants[i] <= 0) ? 0 : (secants[i - 1] + secants[i]) / 2;
+
+	// Limit the tangents so no segment overshoots its points
+	for(size_t i = 0; i + 1 < n; i++){
+		if(secants[i] == 0){
+			tangents[i] = 0;
+			tangents[i + 1] = 0;
+			continue;
+		}
+		double a = tangents[i] / secants[i];
+		double b = tangents[i + 1] / secants[i];
+		double length = a * a + b * b;
+		if(length > 9){
+			double scale = 3 / std::sqrt(length);
+			tangents[i] = scale * a * secants[i];
+			tangents[i + 1] = scale * b * secants[i];
+		}
+	}
+
+	return AxisCurve([&points, &tangents](double x){
+		if(x <= points.front().x)
+			return points.front().y;
+		if(x >= points.back().x)
+			return points.back().y;
+		size_t i = findSegment(points, x);
+		double h = points[i + 1].x - points[i].x;
+		double t = (x - points[i].x) / h;
+		double t2 = t * t, t3 = t2 * t;
+		// Hermite basis functions
+		return (2 * t3 - 3 * t2 + 1) * points[i].y + (t3 - 2 * t2 + t) * h * tangents[i] +
+				(-2 * t3 + 3 * t2) * points[i + 1].y + (t3 - t2) * h * tangents[i + 1];
+	}, deadband, resolution);
+}
+
+size_t team2655::jshelper::AxisCurve::getResolution() const{
+	return table.size() - 1;
+}
+
+double team2655::jshelper::AxisCurve::getDeadband() const{
+	return deadband;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+/// CurveFitter
+////////////////////////////////////////////////////////////////////////
+
+team2655::jshelper::CurveFitter::CurveFitter(double deadband) : deadband(std::fabs(deadband)){
+	if(this->deadband >= 1)
+		throw std::runtime_error("CurveFitter needs a deadband below 1!");
+	scale = 2 / (1 - this->deadband);
+}
+
+void team2655::jshelper::CurveFitter::add(const double *axisValues, const double *outputs, size_t count){
+	for(size_t i = 0; i < count; i++)
+		add(axisValues[i], outputs[i]);
+}
+
+bool team2655::jshelper::CurveFitter::merge(const CurveFitter &other){
+	if(other.deadband != deadband)
+		return false;
+	for(size_t k = 0; k < sums.x.size(); k++)
+		sums.x[k] += other.sums.x[k];
+	for(size_t k = 0; k < sums.xy.size(); k++)
+		sums.xy[k] += other.sums.xy[k];
+	return true;
+}
+
+bool team2655::jshelper::CurveFitter::getConfig(AxisConfig &config) const{
+	std::array<double, 4> a, coeffs;
+	if(!solvePowerSums<3>(sums, a))
+		return false;
+	double halfRange = (1 - deadband) / 2;
+	toPowersOfX<3>(a, deadband + halfRange, halfRange, coeffs);
+	config = AxisConfig{{ coeffs[0], coeffs[1], coeffs[2], coeffs[3], deadband }};
+	return true;
+}
+
+uint64_t team2655::jshelper::CurveFitter::getSampleCount() const{
+	return (uint64_t)sums.x[0];
+}
+
+double team2655::jshelper::CurveFitter::getDeadband() const{
+	return deadband;
+}
+
+void team2655::jshelper::CurveFitter::reset(){
+	sums = PowerSums<3>();
+}
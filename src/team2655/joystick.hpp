@@ -2,6 +2,7 @@
  * joystick.hpp
  * Contains FRC Team 2655's joystick helper code
  * Allows creation of cubic and deadband configurations for use with WPILib Joystick axes
+ * and lookup table curves (exponential, piecewise linear and spline)
  *
  * @author Marcus Behel
  * @version 1.1 8-30-2018 Changed names to make easier to understand and implement
@@ -12,12 +13,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <vector>
 #include <array>
 #include <stdexcept>
 #include <cmath>
 #include <algorithm>
+#include <functional>
 #include <map>
 #include <string>
 
@@ -40,24 +43,397 @@ typedef std::array<double, 5> AxisConfig;
 template <class TYPE>
 bool polyfit(const std::vector<TYPE> & x, const std::vector<TYPE> & y, const int &order, std::vector<TYPE> &coeffs);
 
+/**
+ * Sums of powers of x (and of x times y) over a set of samples. These are all a least squares polynomial fit needs, so
+ * samples do not have to be kept. Adding a sample is O(ORDER) with no allocation.
+ * Keep x within -1 to 1 (see polyfit) so the sums stay well scaled.
+ */
+template <int ORDER>
+struct PowerSums{
+	static_assert(ORDER >= 0, "The order of a polynomial can not be negative");
+
+	std::array<double, 2 * ORDER + 1> x{};  // sum of x^k for k = 0 to 2 * ORDER (x[0] is the number of samples)
+	std::array<double, ORDER + 1> xy{};     // sum of x^k * y for k = 0 to ORDER
+
+	void add(double xValue, double yValue){
+		double power = 1;
+		for(int k = 0; k <= ORDER; k++){
+			x[k] += power;
+			xy[k] += power * yValue;
+			power *= xValue;
+		}
+		for(int k = ORDER + 1; k <= 2 * ORDER; k++){
+			x[k] += power;
+			power *= xValue;
+		}
+	}
+};
+
+/**
+ * Solve the least squares fit for a set of power sums (Gaussian elimination with partial pivoting on the normal equations).
+ * Fixed size and on the stack (no allocation).
+ * @param sums The power sums of the samples
+ * @param coeffs Where to output coefficients (in order of power, so coeffs[k] is for x^k)
+ * @return Was the fitting successful (false if there are not enough different x values for this order)
+ */
+template <int ORDER>
+bool solvePowerSums(const PowerSums<ORDER> &sums, std::array<double, ORDER + 1> &coeffs);
+
+/**
+ * Fit a polynomial function to a set of data points (regression modeling) with the order fixed at compile time.
+ * No allocation, and more accurate than the vector version when the points are bunched together (ex. a deadband near 1):
+ * x is shifted and scaled to -1 to 1 before fitting, then the result is converted back.
+ * @param x The x coordinates
+ * @param y The y coordinates
+ * @param count The number of points
+ * @param coeffs Where to output coefficients (in order of power, so coeffs[k] is for x^k. Same as the vector version.)
+ * @return Was the fitting successful (false if there are fewer than ORDER + 1 different x values)
+ */
+template <int ORDER>
+bool polyfit(const double *x, const double *y, size_t count, std::array<double, ORDER + 1> &coeffs);
+
+/**
+ * Absolute value that can be used in constant expressions (fabs is not constexpr)
+ */
+constexpr double absValue(double value){
+	return (value < 0) ? -value : value;
+}
+
+/**
+ * Find the cubic function that passes through 4 points (exact, so the same as a 3rd order polyfit of 4 points).
+ * constexpr so constant configurations are solved by the compiler. Can also be called at runtime.
+ * The x coordinates must all be different.
+ * @return The coefficients in the order {d, c, b, a} where f(x)=ax^3+bx^2+cx+d
+ */
+constexpr std::array<double, 4> solveCubic(double x0, double x1, double x2, double x3, double y0, double y1, double y2, double y3){
+	// Newton's divided differences then expand to normal (power) form
+	double d01 = (y1 - y0) / (x1 - x0);
+	double d12 = (y2 - y1) / (x2 - x1);
+	double d23 = (y3 - y2) / (x3 - x2);
+	double d012 = (d12 - d01) / (x2 - x0);
+	double d123 = (d23 - d12) / (x3 - x1);
+	double d0123 = (d123 - d012) / (x3 - x0);
+
+	double a = d0123;
+	double b = d012 - d0123 * (x0 + x1 + x2);
+	double c = d01 - d012 * (x0 + x1) + d0123 * (x0 * x1 + x0 * x2 + x1 * x2);
+	double d = y0 - d01 * x0 + d012 * x0 * x1 - d0123 * x0 * x1 * x2;
+	return std::array<double, 4>{{ d, c, b, a }};
+}
+
+/**
+ * Get a set of coefficients that are setup for a non-modified axis with an applied deadband.
+ * constexpr so constant configurations are built by the compiler (no work or static init order issues at startup).
+ * @param deadband
+ * @return The coefficients for the linear function (and the deadband). 5th item is deadband. 4th (as normal) is start of "cubic" function (a=0, b=2, c=1, d=0).
+ */
+constexpr AxisConfig createAxisConfig(double deadband){
+	return AxisConfig{{ 0, 1, 0, 0, absValue(deadband) }}; // This is in the order {d, c, b, a, deadband} where f(x)=ax^3+bx^2+cx+d with x as the joystick input
+}
+
 /**
  * Get cubic function coefficients for a joystick axis.
+ * constexpr so constant configurations are built by the compiler (no work or static init order issues at startup).
+ * Can also be called at runtime (ex. for configurations tuned from the dashboard).
  * @param deadband The threshold an axis must pass before it is treated as non-zero.
  * @param minPower The minimum value a scaled axis will return after moving past the deadband
  * @param midPower Where the "flat" part of the function should be
  * @return The coefficients for the cubic function (and the deadband). 5th item is deadband. 4th (as normal) is start of cubic function.
  */
-AxisConfig createAxisConfig(double deadband, double minPower, double midPower);
+constexpr AxisConfig createAxisConfig(double deadband, double minPower, double midPower){
+
+	// NO NEGATIVE VALUES!!! The function is generated for the 1st quadrant. If the input is negative the output will be negated.
+	deadband = absValue(deadband);
+	minPower = absValue(minPower);
+	midPower = absValue(midPower);
+
+	double midDeadband = (1 - deadband) / 2 + deadband; // Middle of deadband and 1
+
+	// A deadband of 1 (or more) leaves no room for a curve. Default to a linear function that will only apply the deadband.
+	if(midDeadband >= 1)
+		return createAxisConfig(deadband);
+
+	// The points are: the smallest x with a non-zero value, the middle position, the middle position + a tiny bit (so flat part of cubic is here), the max x value (1)
+	// with the values: the minimum value, the mid power, the mid power (for the flat part), the max y value (1)
+	const std::array<double, 4> cubic = solveCubic(deadband, midDeadband, midDeadband + 0.01, 1, minPower, midPower, midPower, 1);
+
+	return AxisConfig{{ cubic[0], cubic[1], cubic[2], cubic[3], deadband }}; // This is in the order {d, c, b, a, deadband} where f(x)=ax^3+bx^2+cx+d with x as the joystick input
+}
 
 /**
- * Get a set of coefficients that are setup for a non-modified axis with an applied deadband.
- * @param deadband
- * @return The coefficients for the linear function (and the deadband). 5th item is deadband. 4th (as normal) is start of "cubic" function (a=0, b=2, c=1, d=0).
+ * A joystick axis curve prepared once from an AxisConfig so shaping a value is a few multiplies and no branches.
+ * A linear (deadband only) config is turned into the same polynomial form (-deadband * scale + scale * x) so both kinds of
+ * config use one path. Gives the same results as getAxisValue (to rounding).
+ * Usage:
+ *     AxisShaper shaper(createAxisConfig(0.1, 0.5, 0));
+ *     double speed = shaper.shape(js->GetRawAxis(1));
+ */
+class AxisShaper{
+private:
+	double c0 = 0, c1 = 1, c2 = 0, c3 = 0; // Horner form: ((c3 * x + c2) * x + c1) * x + c0 for x = |axis value|
+	double deadband = 0;
+	bool linear = true;
+
+	friend class ControllerShaper;
+
+public:
+	/**
+	 * A shaper that returns the value it is given
+	 */
+	constexpr AxisShaper() = default;
+
+	/**
+	 * Prepare a config. constexpr so shapers for constant configs are built by the compiler.
+	 * @param config The config (from createAxisConfig)
+	 * @param deadbandOnly Only apply the deadband (same as getAxisValue's deadbandOnly)
+	 */
+	constexpr explicit AxisShaper(const AxisConfig &config, bool deadbandOnly = false) :
+			deadband(absValue(config[4])),
+			linear(deadbandOnly || (config[0] == 0 && config[1] == 1 && config[2] == 0 && config[3] == 0)){
+		if(linear){
+			// Rescale after the deadband so there is no jump when passing it (same as getAxisValue)
+			double scale = 1 / (1 - deadband);
+			c0 = -deadband * scale;
+			c1 = scale;
+		}else{
+			c0 = config[0];
+			c1 = config[1];
+			c2 = config[2];
+			c3 = config[3];
+		}
+	}
+
+	/**
+	 * Get the scaled value of an axis
+	 * @param axisValue The non-scaled value of the axis
+	 */
+	double shape(double axisValue) const{
+		double x = std::fabs(axisValue);
+		double result = std::copysign(std::fabs(((c3 * x + c2) * x + c1) * x + c0), axisValue);
+		return (x < deadband) ? 0 : result; // A select, not a branch
+	}
+
+	/**
+	 * Shape a buffer of values (ex. recorded samples) with this curve. Written so the compiler can vectorize it.
+	 * @param in The non-scaled values
+	 * @param out Where to put the scaled values (can be the same as in)
+	 * @param count The number of values
+	 */
+	void shape(const double *in, double *out, size_t count) const;
+
+	/**
+	 * Is this a deadband only (linear) curve
+	 */
+	constexpr bool isLinear() const{
+		return linear;
+	}
+
+	constexpr double getDeadband() const{
+		return deadband;
+	}
+};
+
+/**
+ * Shapes every axis of a controller at once, each with its own curve. Curves are stored by coefficient (not by axis)
+ * so all axes are done in one loop the compiler can vectorize.
+ */
+class ControllerShaper{
+public:
+	static const int MAX_AXES = 12; // The most axes WPILib reads from one controller
+
+private:
+	double c0[MAX_AXES], c1[MAX_AXES], c2[MAX_AXES], c3[MAX_AXES];
+	double deadband[MAX_AXES];
+
+public:
+	/**
+	 * Every axis starts out returning the value it is given
+	 */
+	ControllerShaper();
+
+	/**
+	 * Set the curve for one axis
+	 * @param axis The axis number (same as for GetRawAxis)
+	 * @param shaper The curve
+	 * @return Was the axis number valid
+	 */
+	bool setAxis(int axis, const AxisShaper &shaper);
+
+	/**
+	 * Shape all axes
+	 * @param in One non-scaled value per axis (ex. from GetRawAxis)
+	 * @param out Where to put the scaled values (can be the same as in)
+	 * @param axisCount The number of axes in in and out (at most MAX_AXES)
+	 */
+	void shape(const double *in, double *out, int axisCount) const;
+};
+
+/**
+ * A joystick axis curve of any shape (exponential, piecewise linear, spline or any function) compiled into a lookup table.
+ * The shape is evaluated once per table entry when the curve is built. After that shaping a value is one table load and
+ * a linear interpolation, no matter how expensive the shape was to define.
+ * Building allocates the table, so build curves at startup (or when a driver changes them), not every loop.
+ * Shapes are defined for |axis value| from the deadband to 1 and mirrored for negative values (same as AxisConfig).
+ * Usage:
+ *     AxisCurve curve = AxisCurve::exponential(0.1, 3);
+ *     double speed = curve.shape(js->GetRawAxis(1));
+ */
+class AxisCurve{
+public:
+	/**
+	 * Default number of table segments. Keeps the default cubic within 1e-4 of getAxisValue and the table (4KB) in cache.
+	 */
+	static const size_t DEFAULT_RESOLUTION = 256;
+
+	/**
+	 * A control point for piecewise linear and spline curves
+	 */
+	struct Point{
+		double x; // |axis value| (0 to 1)
+		double y; // Output at that value
+	};
+
+private:
+	// The value at the start of a segment and the change to the end of it (so a sample only loads one entry)
+	struct Segment{
+		double value;
+		double slope;
+	};
+
+	std::vector<Segment> table; // resolution + 1 entries. The last one is the value at 1 (for inputs of 1 or more).
+	double deadband = 0;
+	double indexScale = 1;      // Table position of |axis value| - deadband
+	double maxPosition = 1;     // resolution (as a double)
+
+public:
+	/**
+	 * A linear curve (returns the value it is given)
+	 */
+	AxisCurve();
+
+	/**
+	 * Tabulate a shape
+	 * @param shape The output for an |axis value| from deadband to 1. Outputs are made positive (same as getAxisValue).
+	 * @param deadband Values closer to 0 than this return 0
+	 * @param resolution The number of table segments (at least 1)
+	 */
+	AxisCurve(const std::function<double(double)> &shape, double deadband, size_t resolution = DEFAULT_RESOLUTION);
+
+	/**
+	 * Tabulate an AxisConfig (gives the same results as getAxisValue, to the table's resolution)
+	 */
+	static AxisCurve fromConfig(const AxisConfig &config, size_t resolution = DEFAULT_RESOLUTION);
+
+	/**
+	 * An exponential curve from 0 (at the deadband) to 1: (e^(exponent * t) - 1) / (e^exponent - 1) where t goes from 0 to 1
+	 * past the deadband. Larger exponents give finer control near the center. An exponent of 0 is linear and negative
+	 * exponents are more sensitive near the center.
+	 */
+	static AxisCurve exponential(double deadband, double exponent, size_t resolution = DEFAULT_RESOLUTION);
+
+	/**
+	 * Straight lines between control points. Inputs before the first point or after the last use that point's output.
+	 * @param points At least 2 points with different x values (any order)
+	 */
+	static AxisCurve piecewiseLinear(std::vector<Point> points, double deadband, size_t resolution = DEFAULT_RESOLUTION);
+
+	/**
+	 * A smooth curve through control points (monotone cubic, so it never overshoots the points and is only flat where
+	 * the points are). Inputs before the first point or after the last use that point's output.
+	 * @param points At least 2 points with different x values (any order)
+	 */
+	static AxisCurve spline(std::vector<Point> points, double deadband, size_t resolution = DEFAULT_RESOLUTION);
+
+	/**
+	 * Get the scaled value of an axis. Does not allocate or branch.
+	 * @param axisValue The non-scaled value of the axis
+	 */
+	double shape(double axisValue) const{
+		double x = std::fabs(axisValue);
+		// Clamped in this order so a NaN input still gives a valid index
+		double position = std::max(0.0, std::min((x - deadband) * indexScale, maxPosition));
+		size_t index = (size_t)position;
+		const Segment &segment = table[index];
+		double result = std::copysign(segment.value + (position - index) * segment.slope, axisValue);
+		return (x < deadband) ? 0 : result;
+	}
+
+	/**
+	 * Get the number of table segments
+	 */
+	size_t getResolution() const;
+
+	double getDeadband() const;
+};
+
+/**
+ * Fits an axis curve (AxisConfig) to samples as they stream in (ex. recorded stick positions and the outputs a driver
+ * wanted for them). Only the power sums are kept, so any number of samples uses the same small, fixed amount of memory.
+ * Fitters that saw different samples (ex. one per thread or per log file) can be merged into one fit.
+ * Usage:
+ *     CurveFitter fitter(0.1);
+ *     for(...) fitter.add(axisValue, output);
+ *     AxisConfig config;
+ *     if(fitter.getConfig(config)) ...
  */
-AxisConfig createAxisConfig(double deadband);
+class CurveFitter{
+private:
+	PowerSums<3> sums;
+	double deadband;
+	double scale; // Maps deadband to 1 onto -1 to 1 (keeps the sums well scaled, see polyfit)
+
+public:
+	/**
+	 * @param deadband The deadband of the fitted config. Samples inside it are ignored. Must be below 1.
+	 */
+	explicit CurveFitter(double deadband = 0);
+
+	/**
+	 * Add one sample. O(1) and no allocation.
+	 * @param axisValue The non-scaled value of the axis
+	 * @param output The scaled value wanted for it. Negative axis values are mirrored (same as getAxisValue).
+	 */
+	void add(double axisValue, double output){
+		double x = std::fabs(axisValue);
+		if(!(x >= deadband))
+			return;
+		sums.add((x - deadband) * scale - 1, (axisValue < 0) ? -output : output);
+	}
+
+	/**
+	 * Add a buffer of samples
+	 */
+	void add(const double *axisValues, const double *outputs, size_t count);
+
+	/**
+	 * Add the samples another fitter has seen
+	 * @return Could they be merged (false if the deadbands are different)
+	 */
+	bool merge(const CurveFitter &other);
+
+	/**
+	 * Fit a cubic to every sample so far. Can be called any number of times (ex. while samples are still being added).
+	 * @param config Where to put the config (the fitted cubic and the deadband)
+	 * @return Was the fit successful (false if there are not 4 different axis values yet)
+	 */
+	bool getConfig(AxisConfig &config) const;
+
+	/**
+	 * Get the number of samples used (outside the deadband)
+	 */
+	uint64_t getSampleCount() const;
+
+	double getDeadband() const;
+
+	/**
+	 * Forget every sample
+	 */
+	void reset();
+};
 
 /**
  * Get the scaled value of a joystick axis using the pre-calculated cubic function coefficients.
+ * Checks the config every call. Use an AxisShaper for axes that are read every loop.
  * @param coeffs The coefficients for the cubic function for this axis
  * @param axisValue The non-scaled value of the axis.
  * @return The scaled (by cubic function) value of the axis.
@@ -0,0 +1,184 @@
+/**
+ * motionprofile.cpp
+ * See motionprofile.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "motionprofile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace team2655;
+
+const double MotionProfile::MAX_DURATION = 60;
+const size_t MotionProfile::MAX_SAMPLES = 1 << 16;
+
+ProfileLimits::ProfileLimits(double maxVelocity, double maxAcceleration, double maxJerk) :
+		maxVelocity(maxVelocity), maxAcceleration(maxAcceleration), maxJerk(maxJerk){
+
+}
+
+/**
+ * A trapezoidal profile (accelerate, cruise, decelerate) over a positive distance in closed form.
+ * position is also integrated once more so the S-curve's window average can be found exactly.
+ */
+struct Trapezoid{
+	double distance, velocity, acceleration;
+	double accelTime, cruiseTime, totalTime;
+	double accelDistance;
+
+	Trapezoid(double distance, double maxVelocity, double acceleration, double minCruiseTime) :
+			distance(distance), acceleration(acceleration){
+		velocity = std::min(maxVelocity, std::sqrt(distance * acceleration));
+		cruiseTime = (velocity > 0) ? (distance - velocity * velocity / acceleration) / velocity : 0;
+		if(cruiseTime < minCruiseTime){
+			// Cruise for at least minCruiseTime so the S-curve's window never covers the accelerating and decelerating
+			// parts at once (that would double the jerk). Solves distance = v^2 / a + v * minCruiseTime for v.
+			velocity = acceleration * (std::sqrt(minCruiseTime * minCruiseTime + 4 * distance / acceleration) - minCruiseTime) / 2;
+			cruiseTime = minCruiseTime;
+		}
+		accelTime = velocity / acceleration;
+		accelDistance = velocity * accelTime / 2;
+		totalTime = 2 * accelTime + cruiseTime;
+	}
+
+	double velocityAt(double t) const{
+		if(t <= 0 || t >= totalTime)
+			return 0;
+		if(t < accelTime)
+			return acceleration * t;
+		if(t < accelTime + cruiseTime)
+			return velocity;
+		return acceleration * (totalTime - t);
+	}
+
+	double positionAt(double t) const{
+		if(t <= 0)
+			return 0;
+		if(t < accelTime)
+			return acceleration * t * t / 2;
+		if(t < accelTime + cruiseTime)
+			return accelDistance + velocity * (t - accelTime);
+		if(t < totalTime)
+			return distance - acceleration * (totalTime - t) * (totalTime - t) / 2;
+		return distance;
+	}
+
+	// Integral of position from 0 to t
+	double integralAt(double t) const{
+		if(t <= 0)
+			return 0;
+		double cruiseStart = accelTime, cruiseEnd = accelTime + cruiseTime;
+		if(t < cruiseStart)
+			return acceleration * t * t * t / 6;
+		double atCruiseStart = acceleration * cruiseStart * cruiseStart * cruiseStart / 6;
+		if(t < cruiseEnd){
+			double c = t - cruiseStart;
+			return atCruiseStart + accelDistance * c + velocity * c * c / 2;
+		}
+		double atCruiseEnd = atCruiseStart + accelDistance * cruiseTime + velocity * cruiseTime * cruiseTime / 2;
+		double decel = std::min(t, totalTime);
+		double left = totalTime - decel, leftAtCruiseEnd = totalTime - cruiseEnd;
+		double atDecel = atCruiseEnd + distance * (decel - cruiseEnd) +
+						 acceleration * (left * left * left - leftAtCruiseEnd * leftAtCruiseEnd * leftAtCruiseEnd) / 6;
+		return atDecel + distance * (t - decel);
+	}
+};
+
+bool MotionProfile::generate(double distance, const ProfileLimits &limits, double sampleTime){
+	// Anything that fails leaves an empty profile (sample returns 0)
+	positions.clear();
+	velocities.clear();
+	this->distance = 0;
+	duration = 0;
+
+	if(!(limits.maxVelocity > 0) || !(limits.maxAcceleration > 0) || !(limits.maxJerk >= 0) || !(sampleTime > 0) ||
+			!std::isfinite(limits.maxVelocity) || !std::isfinite(limits.maxAcceleration) || !std::isfinite(limits.maxJerk)){
+		std::cerr << "MotionProfileError: invalid limits (velocity and acceleration must be more than 0)" << std::endl;
+		return false;
+	}
+	if(!std::isfinite(distance)){
+		std::cerr << "MotionProfileError: invalid distance " << distance << std::endl;
+		return false;
+	}
+
+	// Length of the S-curve's averaging window (0 for a trapezoid)
+	double window = (limits.maxJerk > 0) ? limits.maxAcceleration / limits.maxJerk : 0;
+	double sign = (distance < 0) ? -1 : 1;
+	Trapezoid trapezoid(std::abs(distance), limits.maxVelocity, limits.maxAcceleration, window);
+
+	double totalTime = (distance == 0) ? 0 : trapezoid.totalTime + window;
+	if(!(totalTime <= MAX_DURATION)){
+		std::cerr << "MotionProfileError: moving " << distance << " would take " << totalTime << "s (the most is "
+				  << MAX_DURATION << "s)" << std::endl;
+		return false;
+	}
+	this->distance = distance;
+	duration = totalTime;
+
+	// Spread the samples evenly so the last one is exactly at the end
+	double wanted = std::ceil(duration / sampleTime);
+	size_t intervals = (wanted >= MAX_SAMPLES - 1) ? MAX_SAMPLES - 1 : std::max<size_t>(1, (size_t)wanted);
+	this->sampleTime = duration / intervals;
+	inverseSampleTime = (duration > 0) ? intervals / duration : 0;
+
+	positions.resize(intervals + 1);
+	velocities.resize(intervals + 1);
+	for(size_t i = 0; i <= intervals; i++){
+		double t = (i == intervals) ? duration : i * this->sampleTime;
+		double position, velocity;
+		if(window > 0){
+			position = (trapezoid.integralAt(t) - trapezoid.integralAt(t - window)) / window;
+			velocity = (trapezoid.positionAt(t) - trapezoid.positionAt(t - window)) / window;
+		}else{
+			position = trapezoid.positionAt(t);
+			velocity = trapezoid.velocityAt(t);
+		}
+		positions[i] = (float)(sign * position);
+		velocities[i] = (float)(sign * velocity);
+	}
+	positions[intervals] = (float)distance;
+	velocities[intervals] = 0;
+	return true;
+}
+
+ProfileSample MotionProfile::sample(double time) const{
+	ProfileSample result = { 0, 0, 0 };
+	if(positions.empty())
+		return result;
+	if(time >= duration){
+		result.position = distance;
+		return result;
+	}
+	if(time <= 0)
+		time = 0;
+
+	double x = time * inverseSampleTime;
+	size_t i = (size_t)x;
+	double fraction = x - i;
+	if(i + 1 >= positions.size()){
+		// Rounding right at the end
+		i = positions.size() - 2;
+		fraction = 1;
+	}
+	result.position = positions[i] + (positions[i + 1] - positions[i]) * fraction;
+	result.velocity = velocities[i] + (velocities[i + 1] - velocities[i]) * fraction;
+	result.acceleration = (velocities[i + 1] - velocities[i]) * inverseSampleTime;
+	return result;
+}
+
+double MotionProfile::getDuration() const{
+	return duration;
+}
+
+double MotionProfile::getDistance() const{
+	return distance;
+}
+
+size_t MotionProfile::getSampleCount() const{
+	return positions.size();
+}
@@ -0,0 +1,82 @@
+/**
+ * motionprofile.hpp
+ * Trapezoidal and S-curve motion profiles stored as lookup tables
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace team2655{
+
+/**
+ * How fast a profile is allowed to move. Units are whatever the distance is in (ex. m, m/s, m/s^2, m/s^3).
+ */
+struct ProfileLimits{
+	double maxVelocity;
+	double maxAcceleration;
+	double maxJerk; // 0 for a trapezoidal profile (acceleration changes instantly)
+
+	ProfileLimits(double maxVelocity, double maxAcceleration, double maxJerk = 0);
+};
+
+/**
+ * Where a profile is at some time
+ */
+struct ProfileSample{
+	double position;
+	double velocity;
+	double acceleration;
+};
+
+/**
+ * A motion profile from 0 to some distance. Generate it when the script is loaded (see AutoCommand::prepare),
+ * then sample it while running. Sampling is a table lookup and a linear interpolation (no profile math).
+ *
+ * With a jerk limit the profile is an S-curve: the trapezoidal profile averaged over a window of maxAcceleration / maxJerk
+ * seconds. That keeps the distance and the velocity and acceleration limits and limits the jerk.
+ */
+class MotionProfile{
+public:
+	static const double MAX_DURATION;  // Longest profile that can be generated (s). Auto is only 15s.
+	static const size_t MAX_SAMPLES;   // Most samples in the table (the sample time is raised to fit)
+
+private:
+	std::vector<float> positions;  // One per sample, evenly spaced from 0 to duration
+	std::vector<float> velocities;
+	double sampleTime = 0;
+	double inverseSampleTime = 0;
+	double duration = 0;
+	double distance = 0;
+
+public:
+	/**
+	 * Generate the profile
+	 * @param distance How far to move (negative to move backwards)
+	 * @param limits The limits to stay within (velocity and acceleration must be more than 0)
+	 * @param sampleTime The most time between samples in the table (s)
+	 * @return Was the profile generated (false if the distance or limits are invalid or it would take over MAX_DURATION)
+	 */
+	bool generate(double distance, const ProfileLimits &limits, double sampleTime = 0.005);
+
+	/**
+	 * Get where the profile is at a time. Before the start it is at 0 and after the end it is stopped at distance.
+	 * @param time Seconds since the start of the profile
+	 */
+	ProfileSample sample(double time) const;
+
+	/**
+	 * How long the profile takes (s)
+	 */
+	double getDuration() const;
+
+	double getDistance() const;
+
+	size_t getSampleCount() const;
+};
+
+}
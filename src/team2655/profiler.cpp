@@ -0,0 +1,138 @@
+/**
+ * profiler.cpp
+ * See profiler.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "profiler.hpp"
+
+#include <chrono>
+#include <limits>
+
+using namespace team2655;
+
+////////////////////////////////////////////////////////////////////////
+/// DurationHistogram
+////////////////////////////////////////////////////////////////////////
+
+const int DurationHistogram::SUB_BUCKETS;
+const int DurationHistogram::BUCKETS;
+
+int DurationHistogram::bucketFor(uint64_t ns){
+	if(ns < SUB_BUCKETS)
+		return ns;
+	// Which power of two, then which quarter of it
+	int octave = 63 - __builtin_clzll(ns);
+	int sub = (ns >> (octave - 2)) & (SUB_BUCKETS - 1);
+	return (octave - 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t DurationHistogram::bucketStart(int bucket){
+	if(bucket < SUB_BUCKETS)
+		return bucket;
+	int octave = bucket / SUB_BUCKETS + 1;
+	int sub = bucket % SUB_BUCKETS;
+	return (uint64_t)(SUB_BUCKETS + sub) << (octave - 2);
+}
+
+DurationHistogram::DurationHistogram(){
+	reset();
+}
+
+void DurationHistogram::record(uint64_t ns){
+	buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(ns, std::memory_order_relaxed);
+
+	uint64_t current = min.load(std::memory_order_relaxed);
+	while(ns < current && !min.compare_exchange_weak(current, ns, std::memory_order_relaxed));
+	current = max.load(std::memory_order_relaxed);
+	while(ns > current && !max.compare_exchange_weak(current, ns, std::memory_order_relaxed));
+}
+
+void DurationHistogram::reset(){
+	for(int i = 0; i < BUCKETS; i++)
+		buckets[i].store(0, std::memory_order_relaxed);
+	count.store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t DurationHistogram::getCount() const{
+	return count.load(std::memory_order_relaxed);
+}
+
+uint64_t DurationHistogram::getMin() const{
+	return getCount() == 0 ? 0 : min.load(std::memory_order_relaxed);
+}
+
+uint64_t DurationHistogram::getMax() const{
+	return max.load(std::memory_order_relaxed);
+}
+
+uint64_t DurationHistogram::getMean() const{
+	uint64_t n = getCount();
+	return n == 0 ? 0 : total.load(std::memory_order_relaxed) / n;
+}
+
+uint64_t DurationHistogram::getPercentile(double percent) const{
+	// Read the buckets once so the total matches what is searched (other threads may still be recording)
+	uint64_t counts[BUCKETS];
+	uint64_t n = 0;
+	for(int i = 0; i < BUCKETS; i++){
+		counts[i] = buckets[i].load(std::memory_order_relaxed);
+		n += counts[i];
+	}
+	if(n == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)(percent / 100.0 * (n - 1)) + 1;
+	uint64_t seen = 0;
+	for(int i = 0; i < BUCKETS; i++){
+		seen += counts[i];
+		if(seen >= rank){
+			// Use the middle of the bucket, but never outside what was actually recorded
+			uint64_t start = bucketStart(i);
+			uint64_t end = (i + 1 < BUCKETS) ? bucketStart(i + 1) : start;
+			uint64_t value = start + (end - start) / 2;
+			if(value < getMin())
+				value = getMin();
+			if(value > getMax())
+				value = getMax();
+			return value;
+		}
+	}
+	return getMax();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// CommandProfile
+////////////////////////////////////////////////////////////////////////
+
+CommandProfile CommandProfile::none;
+
+uint64_t CommandProfile::nowNanos(){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CommandProfile::setEnabled(bool enabled){
+	this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void CommandProfile::addTick(){
+	ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t CommandProfile::getTicks() const{
+	return ticks.load(std::memory_order_relaxed);
+}
+
+void CommandProfile::reset(){
+	ticks.store(0, std::memory_order_relaxed);
+	start.reset();
+	process.reset();
+	complete.reset();
+}
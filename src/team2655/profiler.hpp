@@ -0,0 +1,115 @@
+/**
+ * profiler.hpp
+ * Execution time profiling for Team 2655's autonomous commands
+ * Everything here is fixed size and lock free so it can be recorded from the control loop (without allocating)
+ * and read from another thread.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace team2655{
+
+/**
+ * A histogram of durations (in nanoseconds) with logarithmic buckets.
+ * Each power of two is split into 4 buckets so percentiles are accurate to within about 12%.
+ */
+class DurationHistogram{
+public:
+	static const int SUB_BUCKETS = 4;
+	static const int BUCKETS = 64 * SUB_BUCKETS;
+
+private:
+	std::atomic<uint64_t> buckets[BUCKETS];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> min;
+	std::atomic<uint64_t> max;
+
+	static int bucketFor(uint64_t ns);
+	static uint64_t bucketStart(int bucket);
+
+public:
+	DurationHistogram();
+	DurationHistogram(const DurationHistogram&) = delete;
+	DurationHistogram& operator=(const DurationHistogram&) = delete;
+
+	/**
+	 * Add a duration to the histogram
+	 * @param ns The duration in nanoseconds
+	 */
+	void record(uint64_t ns);
+
+	/**
+	 * Clear everything recorded so far
+	 */
+	void reset();
+
+	uint64_t getCount() const;
+	uint64_t getMin() const;
+	uint64_t getMax() const;
+	uint64_t getMean() const;
+
+	/**
+	 * Get an (approximate) percentile
+	 * @param percent The percentile (0-100). Ex. 50 for the median, 99 for p99
+	 * @return The duration in nanoseconds (0 if nothing has been recorded)
+	 */
+	uint64_t getPercentile(double percent) const;
+};
+
+/**
+ * Timing for one type of command (every command registered under the same name shares a profile)
+ * Time spent in a group includes the time spent in the commands inside it.
+ */
+class CommandProfile{
+private:
+	std::atomic<bool> enabled{false};
+	std::atomic<uint64_t> ticks{0};
+
+public:
+	DurationHistogram start;    // doStart calls
+	DurationHistogram process;  // doProcess calls (includes complete if the command finishes during process)
+	DurationHistogram complete; // doComplete calls
+
+	/**
+	 * A profile that is never enabled. Used by commands that were not created by an AutoManager.
+	 */
+	static CommandProfile none;
+
+	/**
+	 * Get the current time for profiling (steady clock, nanoseconds)
+	 */
+	static uint64_t nowNanos();
+
+	/**
+	 * Is profiling on. This is the only thing checked in the control loop when profiling is off.
+	 */
+	bool isEnabled() const{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	void setEnabled(bool enabled);
+
+	/**
+	 * Count a tick the command ran in (started or processed)
+	 */
+	void addTick();
+
+	/**
+	 * Get the number of ticks the command ran in
+	 */
+	uint64_t getTicks() const;
+
+	/**
+	 * Clear everything recorded so far
+	 */
+	void reset();
+};
+
+}
@@ -0,0 +1,31 @@
+/**
+ * routine.cpp
+ * See routine.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "routine.hpp"
+
+using namespace team2655;
+
+void RoutineCommand::start(const std::vector<AutoArgument> &){
+	// The routine decides when it is done
+	setTimeout(-1);
+	routineLine = 0;
+	run();
+}
+
+void RoutineCommand::process(){
+	run();
+}
+
+void RoutineCommand::complete(){
+
+}
+
+void RoutineCommand::reset(){
+	routineLine = 0;
+	routineWaitUntil = 0;
+}
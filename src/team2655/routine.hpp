@@ -0,0 +1,71 @@
+/**
+ * routine.hpp
+ * Write an AutoCommand as straight line code that waits (for a tick, a time, or a condition) instead of
+ * splitting it across start, process, and complete
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "autonomous.hpp"
+
+/*
+ * Use these in RoutineCommand::run. Each wait saves where it is and returns. The next tick run jumps back to it.
+ *     ROUTINE_BEGIN()            - first line of run
+ *     ROUTINE_YIELD()            - wait for the next tick
+ *     ROUTINE_DELAY(seconds)     - wait until this many seconds (of tick time) have passed
+ *     ROUTINE_UNTIL(condition)   - wait until the condition is true (checked right away then once per tick)
+ *     ROUTINE_END()              - last line of run. The command completes when it gets here.
+ * Local variables are not kept across a wait, so keep anything that must be in members of the command.
+ * Only one ROUTINE_* per line, and no waits inside a switch statement of your own.
+ */
+
+#define ROUTINE_BEGIN() switch(routineLine){ case 0:
+
+#define ROUTINE_YIELD() do{ routineLine = __LINE__; return; case __LINE__:; }while(0)
+
+#define ROUTINE_UNTIL(condition) do{ routineLine = __LINE__; if(false){ case __LINE__:; } if(!(condition)) return; }while(0)
+
+#define ROUTINE_DELAY(seconds) do{ routineWaitUntil = tick.now + (int64_t)(1000000 * (seconds)); \
+		ROUTINE_UNTIL(tick.now >= routineWaitUntil); }while(0)
+
+#define ROUTINE_END() default: break; } routineLine = -1; doComplete()
+
+namespace team2655{
+
+/**
+ * A command written as one function (run) using the ROUTINE_* macros. It is resumed once per tick.
+ * Its state is stored in the command object (which lives in the script's CommandArena) so running it never allocates.
+ * The command has no timeout unless run sets one.
+ */
+class RoutineCommand : public AutoCommand{
+protected:
+	int routineLine = 0;          // Where run resumes (0 is the beginning, -1 is done)
+	int64_t routineWaitUntil = 0; // End of a ROUTINE_DELAY (microseconds)
+
+	/**
+	 * The body of the command. Called on the tick the command starts then once every tick until it reaches ROUTINE_END.
+	 */
+	virtual void run() = 0;
+
+public:
+	void start(const std::vector<AutoArgument> &args) override final;
+	void process() override final;
+
+	/**
+	 * Called when the routine ends or is killed. Override this to stop anything the routine started.
+	 */
+	void complete() override;
+
+	/**
+	 * Starts the routine from the beginning again. Overrides must call this.
+	 */
+	void reset() override;
+};
+
+}
@@ -0,0 +1,339 @@
+/**
+ * telemetry.cpp
+ * See telemetry.hpp for details.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include "telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace team2655;
+using namespace team2655::telemetry;
+
+////////////////////////////////////////////////////////////////////////
+/// Encoding
+////////////////////////////////////////////////////////////////////////
+
+// Small positive and negative numbers both become small unsigned numbers (0, -1, 1, -2 -> 0, 1, 2, 3)
+static uint64_t zigzag(int64_t value){
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value){
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// 7 bits per byte, high bit set on every byte except the last
+static void writeVarint(std::vector<uint8_t> &out, uint64_t value){
+	while(value >= 0x80){
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+
+static bool readVarint(const std::vector<uint8_t> &data, size_t &pos, uint64_t &value){
+	value = 0;
+	for(int shift = 0; shift < 64; shift += 7){
+		if(pos >= data.size())
+			return false;
+		uint8_t byte = data[pos++];
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if((byte & 0x80) == 0)
+			return true;
+	}
+	return false; // Too long to be a varint
+}
+
+// Rounded to the channel's resolution. Anything that is not a number is stored as 0.
+static int64_t quantize(double value, double resolution){
+	double q = std::round(value / resolution);
+	if(std::isnan(q))
+		return 0;
+	// Limited so the difference between two values can not overflow
+	return (int64_t)std::max(-1e18, std::min(1e18, q));
+}
+
+template<class T>
+static void writeRaw(std::vector<uint8_t> &out, const T &value){
+	const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&value);
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<class T>
+static bool readRaw(const std::vector<uint8_t> &data, size_t &pos, T &value){
+	if(data.size() - pos < sizeof(T))
+		return false;
+	std::memcpy(&value, data.data() + pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// Channel
+////////////////////////////////////////////////////////////////////////
+
+Channel::Channel(std::string name, double resolution) : name(name), resolution(resolution){
+
+}
+
+int64_t telemetry::nowMicros(){
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// TelemetryLogger
+////////////////////////////////////////////////////////////////////////
+
+TelemetryLogger::TelemetryLogger(std::vector<Channel> channels, size_t capacity, int64_t drainPeriodMs) :
+		channels(channels), records(capacity), drainPeriodMs(drainPeriodMs){
+	if(this->channels.size() > MAX_CHANNELS){
+		std::cerr << "TelemetryError: only " << MAX_CHANNELS << " channels can be logged. The rest are ignored." << std::endl;
+		this->channels.erase(this->channels.begin() + MAX_CHANNELS, this->channels.end());
+	}
+	for(Channel &channel : this->channels){
+		if(!(channel.resolution > 0)){
+			std::cerr << "TelemetryError: channel \"" << channel.name << "\" needs a resolution above 0" << std::endl;
+			channel.resolution = 1;
+		}
+	}
+}
+
+bool TelemetryLogger::start(const std::string &path){
+	if(running)
+		return false;
+	if(thread.joinable())
+		thread.join();
+
+	file = fopen(path.c_str(), "wb");
+	if(file == nullptr){
+		std::cerr << "TelemetryError: could not create \"" << path << "\"" << std::endl;
+		return false;
+	}
+
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.channelCount = channels.size();
+	header.startMicros = nowMicros();
+
+	std::vector<uint8_t> out;
+	writeRaw(out, header);
+	for(const Channel &channel : channels){
+		writeRaw(out, (uint32_t)channel.name.size());
+		out.insert(out.end(), channel.name.begin(), channel.name.end());
+		writeRaw(out, channel.resolution);
+	}
+	fwrite(out.data(), 1, out.size(), file);
+	fflush(file);
+
+	// Anything left in the queue from a previous log belongs to that log
+	Record old;
+	while(records.pop(old));
+
+	bytesWritten = out.size();
+	dropped = 0;
+	droppedSinceLast = 0;
+	running = true;
+	thread = std::thread(&TelemetryLogger::run, this, header.startMicros);
+	return true;
+}
+
+void TelemetryLogger::stop(){
+	running = false;
+	if(thread.joinable())
+		thread.join();
+	if(file != nullptr){
+		fclose(file);
+		file = nullptr;
+	}
+}
+
+bool TelemetryLogger::isRunning() const{
+	return running;
+}
+
+bool TelemetryLogger::log(const double *values, size_t count){
+	if(!running.load(std::memory_order_relaxed))
+		return false;
+
+	Record record;
+	record.timeMicros = nowMicros();
+	size_t channelCount = channels.size();
+	for(size_t i = 0; i < channelCount; i++)
+		record.values[i] = (i < count) ? values[i] : 0;
+	uint64_t reported = droppedSinceLast.exchange(0, std::memory_order_relaxed);
+	record.dropped = reported;
+
+	if(!records.push(std::move(record))){
+		// Report these with the next record that fits
+		droppedSinceLast.fetch_add(reported + 1, std::memory_order_relaxed);
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+bool TelemetryLogger::log(std::initializer_list<double> values){
+	return log(values.begin(), values.size());
+}
+
+uint64_t TelemetryLogger::getDroppedCount() const{
+	return dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t TelemetryLogger::getBytesWritten() const{
+	return bytesWritten.load(std::memory_order_relaxed);
+}
+
+const std::vector<Channel> &TelemetryLogger::getChannels() const{
+	return channels;
+}
+
+void TelemetryLogger::run(int64_t startMicros){
+	// Below the robot's threads so writing never delays the control loop (Linux allows per thread nice values)
+	if(setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10) != 0)
+		std::cerr << "TelemetryError: could not lower the writer thread's priority" << std::endl;
+
+	std::vector<uint8_t> out;
+	std::vector<int64_t> previous(channels.size(), 0);
+	int64_t previousTime = startMicros;
+
+	bool more = true;
+	while(more){
+		// Check before draining so nothing logged before stop is missed
+		more = running;
+
+		out.clear();
+		Record record;
+		while(records.pop(record)){
+			writeVarint(out, zigzag(record.timeMicros - previousTime));
+			writeVarint(out, record.dropped);
+			previousTime = record.timeMicros;
+			for(size_t i = 0; i < channels.size(); i++){
+				int64_t q = quantize(record.values[i], channels[i].resolution);
+				writeVarint(out, zigzag(q - previous[i]));
+				previous[i] = q;
+			}
+		}
+
+		if(!out.empty()){
+			fwrite(out.data(), 1, out.size(), file);
+			fflush(file); // Keep what was logged if the robot loses power
+			bytesWritten.fetch_add(out.size(), std::memory_order_relaxed);
+		}
+
+		if(more)
+			std::this_thread::sleep_for(std::chrono::milliseconds(drainPeriodMs));
+	}
+}
+
+TelemetryLogger::~TelemetryLogger(){
+	stop();
+}
+
+////////////////////////////////////////////////////////////////////////
+/// TelemetryReader
+////////////////////////////////////////////////////////////////////////
+
+bool TelemetryReader::open(const std::string &path){
+	std::ifstream file(path, std::ios::binary);
+	if(!file){
+		std::cerr << "TelemetryError: could not open \"" << path << "\"" << std::endl;
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+	pos = 0;
+	channels.clear();
+	truncated = false;
+
+	Header header;
+	if(!readRaw(data, pos, header) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0){
+		std::cerr << "TelemetryError: \"" << path << "\" is not a telemetry log" << std::endl;
+		return false;
+	}
+	if(header.version != VERSION){
+		std::cerr << "TelemetryError: \"" << path << "\" is version " << header.version << " (expected " << VERSION << ")" << std::endl;
+		return false;
+	}
+	if(header.channelCount > MAX_CHANNELS){
+		std::cerr << "TelemetryError: \"" << path << "\" has too many channels" << std::endl;
+		return false;
+	}
+
+	for(uint32_t i = 0; i < header.channelCount; i++){
+		uint32_t length;
+		double resolution;
+		if(!readRaw(data, pos, length) || data.size() - pos < length){
+			std::cerr << "TelemetryError: \"" << path << "\" has an incomplete header" << std::endl;
+			return false;
+		}
+		std::string name(data.begin() + pos, data.begin() + pos + length);
+		pos += length;
+		if(!readRaw(data, pos, resolution)){
+			std::cerr << "TelemetryError: \"" << path << "\" has an incomplete header" << std::endl;
+			return false;
+		}
+		channels.push_back(Channel(name, resolution));
+	}
+
+	startMicros = header.startMicros;
+	time = header.startMicros;
+	previous.assign(channels.size(), 0);
+	return true;
+}
+
+const std::vector<Channel> &TelemetryReader::getChannels() const{
+	return channels;
+}
+
+int64_t TelemetryReader::getStartMicros() const{
+	return startMicros;
+}
+
+bool TelemetryReader::next(Record &record){
+	if(pos >= data.size())
+		return false;
+
+	// Decode into locals so a partial record at the end does not change anything
+	size_t at = pos;
+	uint64_t timeDelta = 0, recordDropped = 0, value = 0;
+	int64_t q[MAX_CHANNELS];
+	bool whole = readVarint(data, at, timeDelta) && readVarint(data, at, recordDropped);
+	for(size_t i = 0; whole && i < channels.size(); i++){
+		whole = readVarint(data, at, value);
+		q[i] = previous[i] + unzigzag(value);
+	}
+	if(!whole){
+		truncated = true;
+		return false;
+	}
+
+	pos = at;
+	time += unzigzag(timeDelta);
+	record.timeMicros = time;
+	record.dropped = recordDropped;
+	for(size_t i = 0; i < channels.size(); i++){
+		previous[i] = q[i];
+		record.values[i] = q[i] * channels[i].resolution;
+	}
+	return true;
+}
+
+bool TelemetryReader::isTruncated() const{
+	return truncated;
+}
@@ -0,0 +1,194 @@
+/**
+ * telemetry.hpp
+ * Team 2655's binary telemetry log (.tlm files)
+ * The control loop adds fixed size records to a lock free queue (no file access, no allocation). A low priority thread
+ * writes them to a compact delta encoded file. Convert logs to CSV with the telemetry2csv tool in tools/.
+ *
+ * Layout (all values little endian, the same on the roboRIO and x86 hosts):
+ *     Header
+ *     Channel channels[channelCount]   uint32_t nameLength, char name[nameLength], double resolution
+ *     Records until the end of the file. Each one is a list of varints:
+ *         zigzag(time - previous time)  Microseconds. The first record is relative to the header's startMicros.
+ *         dropped                       Records lost (queue full) just before this one
+ *         zigzag(q - previous q)        One per channel. q is the value divided by the channel's resolution (rounded).
+ * A log cut off part way through a record (ex. the robot lost power) is read up to the last whole record.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "boundedqueue.hpp"
+
+namespace team2655{
+namespace telemetry{
+
+const char MAGIC[8] = { 'T', '2', '6', '5', '5', 'T', 'L', 'M' };
+const uint32_t VERSION = 1;
+
+/**
+ * The most values one record can have
+ */
+const size_t MAX_CHANNELS = 16;
+
+struct Header{
+	char magic[8];
+	uint32_t version;
+	uint32_t channelCount;
+	int64_t startMicros; // Time the log was started (same clock as record times)
+};
+
+/**
+ * One value that is logged every record
+ */
+struct Channel{
+	std::string name;
+	double resolution; // Smallest change that is kept. Values are rounded to a multiple of this.
+
+	Channel(std::string name, double resolution = 0.0001);
+};
+
+/**
+ * One sample of every channel
+ */
+struct Record{
+	int64_t timeMicros = 0;
+	uint64_t dropped = 0; // Records lost just before this one
+	double values[MAX_CHANNELS];
+};
+
+/**
+ * Get the current time in microseconds (steady clock, the same clock as record times)
+ */
+int64_t nowMicros();
+
+}
+
+/**
+ * Logs telemetry records from the control loop without blocking it.
+ * log only copies the record into a lock free queue. A thread at a lower priority than the robot drains the queue,
+ * encodes the records, and writes them to the file. If the queue fills (the writer fell behind) records are dropped
+ * and the number dropped is written with the next record.
+ */
+class TelemetryLogger{
+private:
+	std::vector<telemetry::Channel> channels;
+	BoundedQueue<telemetry::Record> records;
+	int64_t drainPeriodMs;
+
+	FILE *file = nullptr;
+	std::thread thread;
+	std::atomic<bool> running{false};
+
+	std::atomic<uint64_t> droppedSinceLast{0}; // Dropped records not yet reported in the file
+	std::atomic<uint64_t> dropped{0};          // Total dropped since started
+	std::atomic<uint64_t> bytesWritten{0};
+
+	/**
+	 * Body of the writer thread
+	 */
+	void run(int64_t startMicros);
+
+public:
+	/**
+	 * @param channels The values in each record (at most telemetry::MAX_CHANNELS)
+	 * @param capacity The most records that can wait for the writer (rounded up to a power of two)
+	 * @param drainPeriodMs How often the writer thread writes what was logged
+	 */
+	explicit TelemetryLogger(std::vector<telemetry::Channel> channels, size_t capacity = 1024, int64_t drainPeriodMs = 50);
+	TelemetryLogger(const TelemetryLogger&) = delete;
+	TelemetryLogger& operator=(const TelemetryLogger&) = delete;
+
+	/**
+	 * Create the log file (replacing an existing one), write the header, and start the writer thread
+	 * @param path The file to write
+	 * @return Was the file created (false if already started or it could not be opened)
+	 */
+	bool start(const std::string &path);
+
+	/**
+	 * Write everything that was logged then stop the writer thread and close the file
+	 */
+	void stop();
+
+	bool isRunning() const;
+
+	/**
+	 * Log one record. Lock free and does not allocate. Safe from any thread.
+	 * @param values One value per channel (in order). Missing values are logged as 0. Extra values are ignored.
+	 * @param count The number of values
+	 * @return Was the record queued (false if not started or the queue is full)
+	 */
+	bool log(const double *values, size_t count);
+
+	/**
+	 * Log one record. Ex. telemetry.log({ speed, rotation });
+	 */
+	bool log(std::initializer_list<double> values);
+
+	/**
+	 * Get the number of records dropped because the queue was full
+	 */
+	uint64_t getDroppedCount() const;
+
+	/**
+	 * Get the number of bytes written to the file (including the header)
+	 */
+	uint64_t getBytesWritten() const;
+
+	const std::vector<telemetry::Channel> &getChannels() const;
+
+	~TelemetryLogger();
+};
+
+/**
+ * Reads a telemetry log (used by the telemetry2csv tool)
+ */
+class TelemetryReader{
+private:
+	std::vector<telemetry::Channel> channels;
+	std::vector<uint8_t> data;
+	size_t pos = 0;
+	int64_t startMicros = 0;
+	int64_t time = 0;
+	std::vector<int64_t> previous;
+	bool truncated = false;
+
+public:
+	/**
+	 * Read a log file and its header
+	 * @param path The log file
+	 * @return Is it a valid log (errors are printed)
+	 */
+	bool open(const std::string &path);
+
+	const std::vector<telemetry::Channel> &getChannels() const;
+
+	/**
+	 * Get the time the log was started (the first record is after this)
+	 */
+	int64_t getStartMicros() const;
+
+	/**
+	 * Read the next record
+	 * @param record Where to put it
+	 * @return Was there a whole record (false at the end of the log)
+	 */
+	bool next(telemetry::Record &record);
+
+	/**
+	 * Did the log end part way through a record
+	 */
+	bool isTruncated() const;
+};
+
+}
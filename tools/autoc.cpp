@@ -0,0 +1,126 @@
+/**
+ * autoc.cpp
+ * Host side compiler for Team 2655 autonomous scripts
+ * Checks CSV scripts against the robot's commands and writes compiled (.auto) scripts that load without parsing.
+ * Run it before deploying so bad scripts are found at your desk instead of on the field.
+ *
+ * Usage: autoc script.csv [more.csv ...]       Writes script.auto next to each script
+ *        autoc -o out.auto script.csv          Writes to a specific file
+ *
+ * Build (on any Linux host, WPILib is not needed):
+ *     g++ -std=c++14 -O2 -I../src autoc.cpp ../src/team2655/autonomous.cpp ../src/team2655/csvtokenizer.cpp \
+ *         ../src/team2655/compiledscript.cpp ../src/team2655/profiler.cpp ../src/team2655/motionprofile.cpp -o autoc -lpthread
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AutoSchema.hpp"
+#include "team2655/autonomous.hpp"
+
+using namespace team2655;
+
+/*
+ * The robot's commands depend on WPILib so they can not be built here. Each command is described by its
+ * argument schema only (from AutoSchema.hpp, the same one the robot uses).
+ * Compiled scripts are checked again when the robot loads them, so a mismatch is still caught (just later).
+ */
+
+class SchemaCommand : public AutoCommand{
+public:
+	void start(const std::vector<AutoArgument> &) override {  }
+	void process() override {  }
+	void complete() override {  }
+};
+
+class DriveSchema : public SchemaCommand{
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::driveArguments();
+	}
+};
+
+class RotateSchema : public SchemaCommand{
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::rotateArguments();
+	}
+};
+
+class DelaySchema : public SchemaCommand{
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::delayArguments();
+	}
+};
+
+class SquareSchema : public SchemaCommand{
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::squareArguments();
+	}
+};
+
+class CompilerAutoManager : public AutoManager{
+public:
+	CompilerAutoManager(){
+		registerCommand<DriveSchema>(AutoSchema::DRIVE);
+		registerCommand<RotateSchema>(AutoSchema::ROTATE);
+		registerCommand<DelaySchema>(AutoSchema::DELAY);
+		registerCommand<SquareSchema>(AutoSchema::SQUARE);
+		// Only the names (and order) of conditions matter here
+		registerCondition(AutoSchema::DRIVE_STALLED, [](){ return 0.0; }, ConditionType::AtLeast, AutoSchema::DRIVE_STALLED_CURRENT);
+	}
+protected:
+	std::string getScriptDir() override{
+		return ".";
+	}
+};
+
+// script.csv -> script.auto
+static std::string outputName(const std::string &input){
+	size_t dot = input.find_last_of('.');
+	size_t slash = input.find_last_of('/');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return input + ".auto";
+	return input.substr(0, dot) + ".auto";
+}
+
+int main(int argc, char *argv[]){
+	std::string output;
+	std::vector<std::string> inputs;
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "-o" && i + 1 < argc){
+			output = argv[++i];
+		}else if(arg == "-h" || arg == "--help"){
+			inputs.clear();
+			break;
+		}else{
+			inputs.push_back(arg);
+		}
+	}
+
+	if(inputs.empty() || (!output.empty() && inputs.size() != 1)){
+		std::cerr << "Usage: autoc script.csv [more.csv ...]" << std::endl;
+		std::cerr << "       autoc -o out.auto script.csv" << std::endl;
+		return 2;
+	}
+
+	CompilerAutoManager manager;
+	int failed = 0;
+	for(const std::string &input : inputs){
+		std::string out = output.empty() ? outputName(input) : output;
+		if(manager.compileScript(input, out)){
+			std::cout << input << " -> " << out << std::endl;
+		}else{
+			failed++; // compileScript already printed the reason
+		}
+	}
+
+	return (failed == 0) ? 0 : 1;
+}
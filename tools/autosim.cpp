@@ -0,0 +1,532 @@
+/**
+ * autosim.cpp
+ * Host side Monte-Carlo simulator for Team 2655 autonomous scripts
+ * Runs a script many times against a simple differential drive model with random changes to the robot (motor response,
+ * loop timing, starting pose) and prints the spread of where the robot ends up and how long each command took.
+ * Each run uses a virtual clock (ManualAutoClock) so it runs much faster than real time. Runs are spread over every core.
+ *
+ * Usage: autosim [options] script.csv
+ *     -n runs          Number of runs (default 1000)
+ *     -j threads       Worker threads (default: all cores)
+ *     -s seed          Random seed (default 2655). The same seed gives the same results for any number of threads.
+ *     --jitter ms      Standard deviation of the loop period (default 2)
+ *     --motor percent  Standard deviation of each side's motor gain (default 5)
+ *     --pose m         Standard deviation of the starting position (default 0.05). Heading uses 1/10 of this in radians.
+ *     --csv file       Also write the final pose of every run
+ *
+ * Build (on any Linux host, WPILib is not needed):
+ *     g++ -std=c++14 -O2 -I../src autosim.cpp ../src/team2655/autonomous.cpp ../src/team2655/csvtokenizer.cpp \
+ *         ../src/team2655/compiledscript.cpp ../src/team2655/profiler.cpp ../src/team2655/routine.cpp \
+ *         ../src/team2655/motionprofile.cpp -o autosim -lpthread
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AutoSchema.hpp"
+#include "team2655/autonomous.hpp"
+#include "team2655/motionprofile.hpp"
+#include "team2655/routine.hpp"
+
+using namespace team2655;
+
+////////////////////////////////////////////////////////////////////////
+/// Robot model
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * How one simulated robot differs from the ideal one
+ */
+struct RobotVariation{
+	double leftGain = 1, rightGain = 1; // Multiplies each side's top speed
+	double timeConstant = 0.1;          // Seconds for a side to reach 63% of a new speed
+	double startX = 0, startY = 0, startHeading = 0;
+};
+
+/**
+ * A differential drive with a first order response on each side
+ */
+class DriveModel{
+public:
+	static constexpr double MAX_SPEED = 3.0;   // m/s at full output
+	static constexpr double TRACK_WIDTH = 0.6; // m
+
+	double x = 0, y = 0, heading = 0; // m, m, radians (counter clockwise)
+	double leftSpeed = 0, rightSpeed = 0;
+	double leftOutput = 0, rightOutput = 0;
+	RobotVariation variation;
+
+	void reset(const RobotVariation &variation){
+		this->variation = variation;
+		x = variation.startX;
+		y = variation.startY;
+		heading = variation.startHeading;
+		leftSpeed = rightSpeed = leftOutput = rightOutput = 0;
+	}
+
+	/**
+	 * Same mixing as WPILib's DifferentialDrive::ArcadeDrive (without squared inputs). Right is positive forward here.
+	 */
+	void arcadeDrive(double speed, double rotation){
+		speed = std::max(-1.0, std::min(1.0, speed));
+		rotation = std::max(-1.0, std::min(1.0, rotation));
+		double maxInput = std::copysign(std::max(std::abs(speed), std::abs(rotation)), speed);
+		if(speed >= 0){
+			leftOutput = (rotation >= 0) ? maxInput : speed + rotation;
+			rightOutput = (rotation >= 0) ? speed - rotation : maxInput;
+		}else{
+			leftOutput = (rotation >= 0) ? speed + rotation : maxInput;
+			rightOutput = (rotation >= 0) ? maxInput : speed - rotation;
+		}
+	}
+
+	void step(double dt){
+		double alpha = 1 - std::exp(-dt / variation.timeConstant);
+		leftSpeed += (leftOutput * MAX_SPEED * variation.leftGain - leftSpeed) * alpha;
+		rightSpeed += (rightOutput * MAX_SPEED * variation.rightGain - rightSpeed) * alpha;
+
+		double speed = (leftSpeed + rightSpeed) / 2;
+		double turnRate = (rightSpeed - leftSpeed) / TRACK_WIDTH;
+		x += speed * std::cos(heading) * dt;
+		y += speed * std::sin(heading) * dt;
+		heading += turnRate * dt;
+	}
+};
+
+constexpr double DriveModel::MAX_SPEED;
+constexpr double DriveModel::TRACK_WIDTH;
+
+/**
+ * Everything one run records
+ */
+struct RunResult{
+	double x, y, heading;
+	double time;    // Seconds until the script finished
+	bool finished;  // Did the script finish before the end of auto
+	std::vector<std::pair<int, double>> durations; // Command (index in commandNames) and seconds
+};
+
+/**
+ * The run a worker thread is doing. Commands find their robot through this.
+ */
+struct ActiveRun{
+	DriveModel drive;
+	RunResult *result;
+};
+
+static thread_local ActiveRun *activeRun = nullptr;
+
+static const std::vector<std::string> commandNames = { AutoSchema::DRIVE, AutoSchema::ROTATE, AutoSchema::DELAY, AutoSchema::SQUARE };
+
+////////////////////////////////////////////////////////////////////////
+/// Simulated commands
+////////////////////////////////////////////////////////////////////////
+
+/*
+ * These mirror the robot's commands (src/Auto.cpp) but drive the model instead of WPILib.
+ * Their names, arguments, and limits come from AutoSchema.hpp. Keep what they do matching the robot.
+ */
+
+static void recordDuration(int command, int64_t startTime, int64_t now){
+	activeRun->result->durations.push_back(std::make_pair(command, (now - startTime) / 1e6));
+}
+
+class SimDriveCommand : public AutoCommand{
+	MotionProfile profile;
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::driveArguments();
+	}
+	bool prepare(const std::vector<AutoArgument> &args) override{
+		return profile.generate(args[0].getDouble(), AutoSchema::driveLimits);
+	}
+	void start(const std::vector<AutoArgument> &) override{
+		setTimeoutSeconds(profile.getDuration());
+	}
+	void process() override{
+		// The model is not inverted so positive is forward
+		activeRun->drive.arcadeDrive(profile.sample((tick.now - startTime) / 1e6).velocity / AutoSchema::DRIVE_FULL_SPEED, 0);
+	}
+	void complete() override{
+		activeRun->drive.arcadeDrive(0, 0);
+		recordDuration(0, startTime, tick.now);
+	}
+};
+
+class SimRotateCommand : public AutoCommand{
+	MotionProfile profile;
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::rotateArguments();
+	}
+	bool prepare(const std::vector<AutoArgument> &args) override{
+		return profile.generate(args[0].getDouble(), AutoSchema::rotateLimits);
+	}
+	void start(const std::vector<AutoArgument> &) override{
+		setTimeoutSeconds(profile.getDuration());
+	}
+	void process() override{
+		// The model's rotation is clockwise positive
+		activeRun->drive.arcadeDrive(0, -profile.sample((tick.now - startTime) / 1e6).velocity / AutoSchema::ROTATE_FULL_SPEED);
+	}
+	void complete() override{
+		activeRun->drive.arcadeDrive(0, 0);
+		recordDuration(1, startTime, tick.now);
+	}
+};
+
+class SimDelayCommand : public AutoCommand{
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::delayArguments();
+	}
+	void start(const std::vector<AutoArgument> &args) override{
+		setTimeoutSeconds(args[0].getDouble());
+	}
+	void process() override{
+		activeRun->drive.arcadeDrive(0, 0);
+	}
+	void complete() override{
+		recordDuration(2, startTime, tick.now);
+	}
+};
+
+class SimSquareCommand : public RoutineCommand{
+	int side = 0;
+	int64_t segmentEnd = 0;
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return AutoSchema::squareArguments();
+	}
+	bool prepare(const std::vector<AutoArgument> &args) override{
+		return AutoSchema::checkSquareArguments(args);
+	}
+	void run() override{
+		ROUTINE_BEGIN();
+		for(side = 0; side < 4; side++){
+			segmentEnd = tick.now + (int64_t)(1000000 * arguments[0].getDouble());
+			while(tick.now < segmentEnd){
+				activeRun->drive.arcadeDrive(0.5, 0);
+				ROUTINE_YIELD();
+			}
+			activeRun->drive.arcadeDrive(0, 0);
+			ROUTINE_DELAY(0.25);
+			segmentEnd = tick.now + (int64_t)(1000000 * arguments[1].getDouble());
+			while(tick.now < segmentEnd){
+				activeRun->drive.arcadeDrive(0, 0.5);
+				ROUTINE_YIELD();
+			}
+		}
+		ROUTINE_END();
+	}
+	void complete() override{
+		activeRun->drive.arcadeDrive(0, 0);
+		recordDuration(3, startTime, tick.now);
+	}
+};
+
+class SimAutoManager : public AutoManager{
+	std::string scriptDir;
+public:
+	SimAutoManager(const std::string &scriptDir) : scriptDir(scriptDir){
+		registerCommand<SimDriveCommand>(AutoSchema::DRIVE);
+		registerCommand<SimRotateCommand>(AutoSchema::ROTATE);
+		registerCommand<SimDelayCommand>(AutoSchema::DELAY);
+		registerCommand<SimSquareCommand>(AutoSchema::SQUARE);
+		// The model has no motor current so the robot never stalls here
+		registerCondition(AutoSchema::DRIVE_STALLED, [](){ return 0.0; }, ConditionType::AtLeast, AutoSchema::DRIVE_STALLED_CURRENT);
+	}
+protected:
+	std::string getScriptDir() override{
+		return scriptDir;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////
+/// Work stealing pool
+////////////////////////////////////////////////////////////////////////
+
+/**
+ * Each worker has its own queue of run numbers. A worker takes from the back of its own queue and
+ * when it is empty steals from the front of another worker's queue, so slow runs do not leave cores idle.
+ */
+class WorkQueues{
+	struct Queue{
+		std::mutex mutex;
+		std::deque<int> runs;
+	};
+	std::vector<std::unique_ptr<Queue>> queues;
+
+public:
+	WorkQueues(int workers, int runs){
+		for(int i = 0; i < workers; i++)
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		for(int i = 0; i < runs; i++)
+			queues[i % workers]->runs.push_back(i);
+	}
+
+	bool next(int worker, int &run){
+		{
+			Queue &own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if(!own.runs.empty()){
+				run = own.runs.back();
+				own.runs.pop_back();
+				return true;
+			}
+		}
+		for(size_t i = 1; i < queues.size(); i++){
+			Queue &victim = *queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if(!victim.runs.empty()){
+				run = victim.runs.front();
+				victim.runs.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////
+/// Simulation
+////////////////////////////////////////////////////////////////////////
+
+struct Options{
+	int runs = 1000;
+	int threads = 0;
+	unsigned long seed = 2655;
+	double jitterMs = 2;
+	double motorPercent = 5;
+	double poseError = 0.05;
+	std::string csv;
+	std::string script;
+};
+
+static const double LOOP_PERIOD = 0.02;   // IterativeRobot period (s)
+static const double AUTO_LENGTH = 15.0;   // Length of the autonomous period (s)
+static const double PHYSICS_STEP = 0.001; // Model step (s)
+
+/**
+ * Run the script once
+ * @param manager A manager with the script loaded (restarted here)
+ * @param clock The manager's clock
+ * @param options Amount of variation
+ * @param run The run number (picks the random numbers)
+ * @param result Where to put the results
+ */
+static void simulate(SimAutoManager &manager, ManualAutoClock &clock, const Options &options, int run, RunResult &result){
+	// Seeded by run number so results do not depend on which thread does the run
+	std::mt19937_64 random(options.seed * 1000003 + run);
+	std::normal_distribution<double> normal(0, 1);
+
+	RobotVariation variation;
+	variation.leftGain = 1 + normal(random) * options.motorPercent / 100;
+	variation.rightGain = 1 + normal(random) * options.motorPercent / 100;
+	variation.timeConstant = std::max(0.02, 0.1 + normal(random) * 0.02);
+	variation.startX = normal(random) * options.poseError;
+	variation.startY = normal(random) * options.poseError;
+	variation.startHeading = normal(random) * options.poseError / 10;
+
+	ActiveRun active;
+	active.drive.reset(variation);
+	active.result = &result;
+	activeRun = &active;
+	result.durations.clear();
+
+	manager.restart();
+	clock.setMicros(0);
+	double time = 0;
+	result.finished = false;
+	while(time < AUTO_LENGTH){
+		if(!manager.process()){
+			result.finished = true;
+			break;
+		}
+
+		double period = std::max(0.001, LOOP_PERIOD + normal(random) * options.jitterMs / 1000);
+		for(double t = 0; t < period; t += PHYSICS_STEP)
+			active.drive.step(std::min(PHYSICS_STEP, period - t));
+		time += period;
+		clock.setMicros((int64_t)(time * 1e6));
+	}
+	if(!result.finished)
+		manager.killAuto(); // Completes the running command (records its duration)
+
+	result.x = active.drive.x;
+	result.y = active.drive.y;
+	result.heading = active.drive.heading;
+	result.time = time;
+	activeRun = nullptr;
+}
+
+struct Summary{
+	double mean, stddev, min, p5, p50, p95, max;
+};
+
+static Summary summarize(std::vector<double> values){
+	Summary s = {};
+	if(values.empty())
+		return s;
+	std::sort(values.begin(), values.end());
+	double sum = 0, squares = 0;
+	for(double v : values){
+		sum += v;
+		squares += v * v;
+	}
+	s.mean = sum / values.size();
+	s.stddev = std::sqrt(std::max(0.0, squares / values.size() - s.mean * s.mean));
+	s.min = values.front();
+	s.max = values.back();
+	s.p5 = values[(size_t)(0.05 * (values.size() - 1))];
+	s.p50 = values[(size_t)(0.50 * (values.size() - 1))];
+	s.p95 = values[(size_t)(0.95 * (values.size() - 1))];
+	return s;
+}
+
+static void printSummary(const std::string &name, const Summary &s, size_t count){
+	std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(3)
+			  << std::setw(8) << count << std::setw(10) << s.mean << std::setw(10) << s.stddev << std::setw(10) << s.min
+			  << std::setw(10) << s.p5 << std::setw(10) << s.p50 << std::setw(10) << s.p95 << std::setw(10) << s.max << std::endl;
+}
+
+static bool parseOptions(int argc, char *argv[], Options &options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if(arg == "-n" && hasValue){
+			options.runs = std::atoi(argv[++i]);
+		}else if(arg == "-j" && hasValue){
+			options.threads = std::atoi(argv[++i]);
+		}else if(arg == "-s" && hasValue){
+			options.seed = std::strtoul(argv[++i], nullptr, 10);
+		}else if(arg == "--jitter" && hasValue){
+			options.jitterMs = std::atof(argv[++i]);
+		}else if(arg == "--motor" && hasValue){
+			options.motorPercent = std::atof(argv[++i]);
+		}else if(arg == "--pose" && hasValue){
+			options.poseError = std::atof(argv[++i]);
+		}else if(arg == "--csv" && hasValue){
+			options.csv = argv[++i];
+		}else if(arg[0] == '-' || !options.script.empty()){
+			return false;
+		}else{
+			options.script = arg;
+		}
+	}
+	return !options.script.empty() && options.runs > 0;
+}
+
+int main(int argc, char *argv[]){
+	Options options;
+	if(!parseOptions(argc, argv, options)){
+		std::cerr << "Usage: autosim [-n runs] [-j threads] [-s seed] [--jitter ms] [--motor percent] [--pose m] [--csv file] script.csv" << std::endl;
+		return 2;
+	}
+	if(options.threads <= 0)
+		options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	size_t slash = options.script.find_last_of('/');
+	std::string scriptDir = (slash == std::string::npos) ? "." : options.script.substr(0, slash);
+	std::string scriptName = (slash == std::string::npos) ? options.script : options.script.substr(slash + 1);
+
+	// Load once to report errors before starting the workers
+	{
+		SimAutoManager check(scriptDir);
+		if(!check.loadScript(scriptName))
+			return 1;
+	}
+
+	std::vector<RunResult> results(options.runs);
+	WorkQueues queues(options.threads, options.runs);
+	std::atomic<bool> failed(false);
+	std::vector<std::thread> workers;
+	auto begin = std::chrono::steady_clock::now();
+
+	for(int worker = 0; worker < options.threads; worker++){
+		workers.emplace_back([&, worker](){
+			// One manager per worker. The script is loaded once and restarted for each run.
+			ManualAutoClock clock;
+			SimAutoManager manager(scriptDir);
+			manager.setClock(&clock);
+			if(!manager.loadScript(scriptName)){
+				failed = true;
+				return;
+			}
+			int run;
+			while(queues.next(worker, run))
+				simulate(manager, clock, options, run, results[run]);
+		});
+	}
+	for(std::thread &worker : workers)
+		worker.join();
+	if(failed)
+		return 1;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	// Final poses
+	std::vector<double> xs, ys, headings, times;
+	std::vector<std::vector<double>> durations(commandNames.size());
+	int finished = 0;
+	for(const RunResult &result : results){
+		xs.push_back(result.x);
+		ys.push_back(result.y);
+		headings.push_back(result.heading * 180 / M_PI);
+		times.push_back(result.time);
+		if(result.finished)
+			finished++;
+		for(const auto &duration : result.durations)
+			durations[duration.first].push_back(duration.second);
+	}
+
+	double simulated = 0;
+	for(double time : times)
+		simulated += time;
+	std::cout << options.runs << " runs of " << options.script << " on " << options.threads << " threads in " << std::setprecision(3)
+			  << seconds << " s (" << (simulated / seconds) << "x real time)" << std::endl;
+	std::cout << finished << " finished within " << AUTO_LENGTH << " s" << std::endl << std::endl;
+
+	std::cout << std::left << std::setw(16) << "" << std::right << std::setw(8) << "count" << std::setw(10) << "mean"
+			  << std::setw(10) << "stddev" << std::setw(10) << "min" << std::setw(10) << "p5" << std::setw(10) << "p50"
+			  << std::setw(10) << "p95" << std::setw(10) << "max" << std::endl;
+	printSummary("x (m)", summarize(xs), xs.size());
+	printSummary("y (m)", summarize(ys), ys.size());
+	printSummary("heading (deg)", summarize(headings), headings.size());
+	printSummary("script (s)", summarize(times), times.size());
+	for(size_t i = 0; i < commandNames.size(); i++){
+		if(!durations[i].empty())
+			printSummary(commandNames[i] + " (s)", summarize(durations[i]), durations[i].size());
+	}
+
+	if(!options.csv.empty()){
+		std::ofstream file(options.csv, std::ios::trunc);
+		file << "run,x,y,heading_deg,time,finished\n";
+		for(size_t i = 0; i < results.size(); i++){
+			file << i << "," << results[i].x << "," << results[i].y << "," << results[i].heading * 180 / M_PI << ","
+				 << results[i].time << "," << results[i].finished << "\n";
+		}
+		if(!file.good()){
+			std::cerr << "Could not write " << options.csv << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,430 @@
+/**
+ * benchmark.cpp
+ * Host side benchmarks for the team2655 library (autonomous scripts and joystick helpers)
+ * Results are printed as JSON so runs from different commits can be compared.
+ *
+ * Usage: benchmark [output.json]      Prints to stdout if no file is given
+ *
+ * Build (on any Linux host, WPILib is not needed). Use the same optimization level the robot uses.
+ *     g++ -std=c++14 -O2 -I../src benchmark.cpp ../src/team2655/autonomous.cpp ../src/team2655/csvtokenizer.cpp \
+ *         ../src/team2655/compiledscript.cpp ../src/team2655/profiler.cpp ../src/team2655/joystick.cpp \
+ *         ../src/team2655/motionprofile.cpp ../src/team2655/inputfilter.cpp -o benchmark -lpthread
+ *
+ * This only measures speed. The allocation, accuracy, and motion profile checks are in check.cpp.
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "AutoSchema.hpp"
+#include "team2655/autonomous.hpp"
+#include "team2655/inputfilter.hpp"
+#include "team2655/joystick.hpp"
+#include "team2655/motionprofile.hpp"
+
+using namespace team2655;
+
+////////////////////////////////////////////////////////////////////////
+/// Benchmark helpers
+////////////////////////////////////////////////////////////////////////
+
+struct Result{
+	std::string name;
+	std::string param;
+	std::string op; // What one operation is (line, tick, sample, call)
+	double nsPerOp;
+	double opsPerSec;
+	long iterations;
+};
+
+static std::vector<Result> results;
+
+// Generated scripts (removed at the end)
+static std::vector<std::string> tempFiles;
+
+// Stops the compiler from optimizing away a value
+static volatile double sink;
+
+/**
+ * Run fn repeatedly for at least minSeconds and record the average time per operation
+ * @param op What one operation is (for the results)
+ * @param opsPerCall How many operations one call of fn does (ex. samples shaped)
+ */
+template<class F>
+static void bench(const std::string &name, const std::string &param, const std::string &op, long opsPerCall, F fn, double minSeconds = 0.25){
+	typedef std::chrono::steady_clock Clock;
+	fn(); // Warm up
+
+	long calls = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0;
+	do{
+		fn();
+		calls++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	}while(elapsed < minSeconds);
+
+	double ops = (double)calls * opsPerCall;
+	results.push_back({ name, param, op, elapsed * 1e9 / ops, ops / elapsed, calls });
+	std::cerr << name << " [" << param << "]: " << elapsed * 1e9 / ops << " ns/" << op << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// Commands and manager used by the autonomous benchmarks
+////////////////////////////////////////////////////////////////////////
+
+// Like the robot's DRIVE command without hardware. Runs for a number of ticks.
+class TickCommand : public AutoCommand{
+	long ticks = 0;
+	long remaining = 0;
+public:
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return { {"direction", ArgumentType::Int}, {"ticks", ArgumentType::Double} };
+	}
+	void start(const std::vector<AutoArgument> &args) override{
+		setTimeout(-1);
+		ticks = args[0].getInt();
+		remaining = (long)args[1].getDouble();
+	}
+	void process() override{
+		sink = sink + ticks;
+		if(--remaining <= 0)
+			doComplete();
+	}
+	void complete() override {  }
+};
+
+class BenchAutoManager : public AutoManager{
+	std::string dir;
+public:
+	explicit BenchAutoManager(const std::string &dir) : dir(dir){
+		registerCommand<TickCommand>("DRIVE");
+		registerCommand<TickCommand>("ROTATE");
+	}
+protected:
+	std::string getScriptDir() override{
+		return dir;
+	}
+};
+
+static void writeScript(const std::string &path, long lines, bool parallel){
+	tempFiles.push_back(path);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if(parallel)
+		file << "PARALLEL\n";
+	for(long i = 0; i < lines; i++)
+		file << ((i % 2) ? "DRIVE" : "ROTATE") << ", -1, 2,    comment for line " << i << "\n";
+	if(parallel)
+		file << "END\n";
+}
+
+////////////////////////////////////////////////////////////////////////
+/// Benchmarks
+////////////////////////////////////////////////////////////////////////
+
+static void benchLoadScript(const std::string &dir){
+	BenchAutoManager manager(dir);
+	for(long lines : { 10L, 100L, 1000L, 10000L, 100000L }){
+		std::string name = "load" + std::to_string(lines) + ".csv";
+		writeScript(dir + "/" + name, lines, false);
+		bench("AutoManager::loadScript (csv)", std::to_string(lines) + " lines", "line", lines, [&](){
+			manager.loadScript(name);
+		});
+
+		std::string compiled = "load" + std::to_string(lines) + ".auto";
+		manager.compileScript(dir + "/" + name, dir + "/" + compiled);
+		tempFiles.push_back(dir + "/" + compiled);
+		bench("AutoManager::loadScript (compiled)", std::to_string(lines) + " lines", "line", lines, [&](){
+			manager.loadScript(compiled);
+		});
+	}
+}
+
+static void benchProcess(const std::string &dir){
+	BenchAutoManager manager(dir);
+	ManualAutoClock clock;
+	manager.setClock(&clock);
+
+	for(long commands : { 1L, 10L, 100L, 1000L }){
+		// Commands one after another (each takes 2 ticks)
+		std::string name = "process" + std::to_string(commands) + ".csv";
+		writeScript(dir + "/" + name, commands, false);
+		manager.loadScript(name);
+		long ticks = 0;
+		manager.restart();
+		while(manager.process())
+			ticks++;
+		bench("AutoManager::process (sequential)", std::to_string(commands) + " commands", "tick", ticks, [&](){
+			manager.restart();
+			while(manager.process())
+				clock.advanceMicros(20000);
+		});
+
+		// All commands ticked every period in a PARALLEL group
+		name = "parallel" + std::to_string(commands) + ".csv";
+		writeScript(dir + "/" + name, commands, true);
+		manager.loadScript(name);
+		ticks = 0;
+		manager.restart();
+		while(manager.process())
+			ticks++;
+		bench("AutoManager::process (parallel)", std::to_string(commands) + " commands", "tick", ticks, [&](){
+			manager.restart();
+			while(manager.process())
+				clock.advanceMicros(20000);
+		});
+	}
+}
+
+static void benchJoystick(){
+	// Samples covering the whole axis range
+	std::vector<double> samples(4096);
+	for(size_t i = 0; i < samples.size(); i++)
+		samples[i] = -1.0 + 2.0 * i / (samples.size() - 1);
+
+	jshelper::AxisConfig cubic = jshelper::createAxisConfig(0.1, 0.5, 0);
+	jshelper::AxisConfig linear = jshelper::createAxisConfig(0.1);
+
+	bench("jshelper::getAxisValue", "cubic", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += jshelper::getAxisValue(cubic, sample);
+		sink = total;
+	});
+	bench("jshelper::getAxisValue", "linear", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += jshelper::getAxisValue(linear, sample);
+		sink = total;
+	});
+
+	jshelper::AxisShaper cubicShaper(cubic);
+	jshelper::AxisShaper linearShaper(linear);
+	bench("jshelper::AxisShaper::shape", "cubic", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += cubicShaper.shape(sample);
+		sink = total;
+	});
+	bench("jshelper::AxisShaper::shape", "linear", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += linearShaper.shape(sample);
+		sink = total;
+	});
+
+	std::vector<double> shaped(samples.size());
+	bench("jshelper::AxisShaper::shape (batch)", "cubic", "sample", samples.size(), [&](){
+		cubicShaper.shape(samples.data(), shaped.data(), samples.size());
+		sink = shaped[samples.size() / 3];
+	});
+
+	// A 6 axis controller with a mix of curves, shaped every loop
+	jshelper::ControllerShaper controller;
+	for(int axis = 0; axis < 6; axis++)
+		controller.setAxis(axis, (axis % 2) ? linearShaper : cubicShaper);
+	bench("jshelper::ControllerShaper::shape", "6 axes", "sample", samples.size(), [&](){
+		double axes[6];
+		double total = 0;
+		for(size_t i = 0; i + 6 <= samples.size(); i += 6){
+			controller.shape(&samples[i], axes, 6);
+			total += axes[0] + axes[5];
+		}
+		sink = total;
+	});
+
+	// Lookup table curves cost the same per sample whatever the shape
+	jshelper::AxisCurve cubicCurve = jshelper::AxisCurve::fromConfig(cubic);
+	jshelper::AxisCurve splineCurve = jshelper::AxisCurve::spline({ {0.1, 0.2}, {0.5, 0.3}, {0.7, 0.35}, {1, 1} }, 0.1);
+	bench("jshelper::AxisCurve::shape", "cubic", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += cubicCurve.shape(sample);
+		sink = total;
+	});
+	bench("jshelper::AxisCurve::shape", "spline", "sample", samples.size(), [&](){
+		double total = 0;
+		for(double sample : samples)
+			total += splineCurve.shape(sample);
+		sink = total;
+	});
+	bench("jshelper::AxisCurve::spline", std::to_string(jshelper::AxisCurve::DEFAULT_RESOLUTION) + " segments", "call", 1, [&](){
+		sink = jshelper::AxisCurve::spline({ {0.1, 0.2}, {0.5, 0.3}, {0.7, 0.35}, {1, 1} }, 0.1).shape(0.5);
+	});
+
+	// Read through volatile so the runtime path is timed (constant arguments can be solved by the compiler)
+	volatile double deadband = 0.1;
+	bench("jshelper::createAxisConfig", "cubic", "call", 1, [&](){
+		sink = jshelper::createAxisConfig(deadband, 0.5, 0)[3];
+	});
+
+	std::vector<double> x = { 0.1, 0.55, 0.56, 1 };
+	std::vector<double> y = { 0.5, 0, 0, 1 };
+	bench("jshelper::polyfit", "4 points, order 3", "call", 1, [&](){
+		std::vector<double> coeffs;
+		jshelper::polyfit<double>(x, y, 3, coeffs);
+		sink = coeffs[0];
+	});
+	bench("jshelper::polyfit<3>", "4 points", "call", 1, [&](){
+		std::array<double, 4> coeffs;
+		jshelper::polyfit<3>(x.data(), y.data(), x.size(), coeffs);
+		sink = coeffs[0];
+	});
+
+	// Recorded stick positions (and the outputs wanted for them)
+	std::vector<double> recordedX(samples.size()), recordedY(samples.size());
+	for(size_t i = 0; i < samples.size(); i++){
+		recordedX[i] = std::fabs(samples[i]);
+		recordedY[i] = jshelper::getAxisValue(cubic, recordedX[i]);
+	}
+	bench("jshelper::polyfit", std::to_string(samples.size()) + " points, order 3", "call", 1, [&](){
+		std::vector<double> coeffs;
+		jshelper::polyfit<double>(recordedX, recordedY, 3, coeffs);
+		sink = coeffs[0];
+	});
+	bench("jshelper::polyfit<3>", std::to_string(samples.size()) + " points", "call", 1, [&](){
+		std::array<double, 4> coeffs;
+		jshelper::polyfit<3>(recordedX.data(), recordedY.data(), recordedX.size(), coeffs);
+		sink = coeffs[0];
+	});
+
+	// Streaming fit of the same samples (nothing is kept, so this is the cost per logged sample)
+	bench("jshelper::CurveFitter::add", "order 3", "sample", samples.size(), [&](){
+		jshelper::CurveFitter fitter(0.1);
+		fitter.add(samples.data(), recordedY.data(), samples.size());
+		sink = fitter.getSampleCount();
+	});
+	jshelper::CurveFitter fitter(0.1);
+	fitter.add(samples.data(), recordedY.data(), samples.size());
+	bench("jshelper::CurveFitter::getConfig", "order 3", "call", 1, [&](){
+		jshelper::AxisConfig config;
+		fitter.getConfig(config);
+		sink = config[3];
+	});
+}
+
+// The robot's filter (see OI::configureInputFilter) and a full driver station (6 controllers, 6 axes each)
+static void setupInputFilters(InputFilter &robot, InputFilter &full){
+	jshelper::AxisConfig cubic = jshelper::createAxisConfig(0.1, 0.5, 0);
+	robot.addCurve(0, 1, cubic);
+	robot.addCurve(0, 2, jshelper::createAxisConfig(0.1));
+	for(int controller = 0; controller < InputSnapshot::MAX_CONTROLLERS; controller++){
+		for(int axis = 0; axis < 6; axis++){
+			full.addCurve(controller, axis, cubic);
+			full.addLowPass(controller, axis, 0.05);
+		}
+		full.addDebounce(controller, 1, 0.05);
+	}
+}
+
+static void benchInputFilter(){
+	InputFilter robot, full;
+	setupInputFilters(robot, full);
+
+	// One snapshot per 20ms loop with the sticks moving
+	std::vector<InputSnapshot> snapshots(500);
+	for(size_t i = 0; i < snapshots.size(); i++){
+		InputSnapshot &snapshot = snapshots[i];
+		snapshot.timeMicros = i * 20000;
+		snapshot.controllerCount = InputSnapshot::MAX_CONTROLLERS;
+		for(ControllerSnapshot &controller : snapshot.controllers){
+			controller.axisCount = 6;
+			for(int axis = 0; axis < 6; axis++)
+				controller.axes[axis] = std::sin(i * 0.05 + axis);
+			controller.buttons = (i % 7 == 0) ? 1 : 0;
+		}
+	}
+
+	InputSnapshot filtered;
+	bench("InputFilter::apply", "robot (2 stages)", "tick", snapshots.size(), [&](){
+		robot.reset();
+		for(const InputSnapshot &snapshot : snapshots)
+			robot.apply(snapshot, filtered);
+		sink = filtered.controllers[0].axes[1];
+	});
+	bench("InputFilter::apply", "6 controllers (78 stages)", "tick", snapshots.size(), [&](){
+		full.reset();
+		for(const InputSnapshot &snapshot : snapshots)
+			full.apply(snapshot, filtered);
+		sink = filtered.controllers[5].axes[5];
+	});
+}
+
+static void benchMotionProfile(){
+	const ProfileLimits &limits = AutoSchema::driveLimits;
+
+	bench("MotionProfile::generate", "2 m, s-curve", "call", 1, [&](){
+		MotionProfile profile;
+		profile.generate(2.0, limits);
+		sink = profile.getDuration();
+	});
+
+	// Sample every 5ms like a 200Hz loop
+	MotionProfile profile;
+	profile.generate(2.0, limits);
+	std::vector<double> times;
+	for(double t = 0; t < profile.getDuration(); t += 0.005)
+		times.push_back(t);
+	bench("MotionProfile::sample", "2 m, s-curve", "sample", times.size(), [&](){
+		double total = 0;
+		for(double t : times)
+			total += profile.sample(t).velocity;
+		sink = total;
+	});
+}
+
+static std::string toJSON(){
+	std::ostringstream out;
+	out << "{\n  \"benchmarks\": [\n";
+	for(size_t i = 0; i < results.size(); i++){
+		const Result &r = results[i];
+		out << "    { \"name\": \"" << r.name << "\", \"param\": \"" << r.param << "\", \"op\": \"" << r.op << "\", \"ns_per_op\": " << r.nsPerOp
+			<< ", \"ops_per_sec\": " << r.opsPerSec << ", \"iterations\": " << r.iterations << " }"
+			<< ((i + 1 < results.size()) ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+	return out.str();
+}
+
+int main(int argc, char *argv[]){
+	// Scripts are generated in a temporary directory
+	char dirTemplate[] = "/tmp/team2655-benchmark-XXXXXX";
+	if(mkdtemp(dirTemplate) == nullptr){
+		std::cerr << "Could not create a temporary directory" << std::endl;
+		return 1;
+	}
+	std::string dir = dirTemplate;
+
+	benchLoadScript(dir);
+	benchProcess(dir);
+	benchJoystick();
+	benchInputFilter();
+	benchMotionProfile();
+
+	std::string json = toJSON();
+	if(argc > 1){
+		std::ofstream(argv[1]) << json;
+	}else{
+		std::cout << json;
+	}
+
+	for(const std::string &file : tempFiles)
+		unlink(file.c_str());
+	rmdir(dir.c_str());
+
+	return 0;
+}
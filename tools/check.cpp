@@ -0,0 +1,511 @@
+/**
+ * check.cpp
+ * Host side checks for the team2655 library. Each check prints what it found and the program exits with 1 if any fail,
+ * so it can be run on its own before deploying (the benchmark only measures speed).
+ *     - AutoManager::process, jshelper::getAxisValue, jshelper::AxisCurve::shape, jshelper::polyfit<3> and
+ *       InputFilter::apply never allocate
+ *     - The fixed order polyfit stays accurate with bunched together points
+ *     - Motion profiles stay within their limits, end at the target, and take the analytic minimum time
+ *     - Injected commands are not carried over when a script is killed, restarted or changed
+ *     - Loops of steps that finish as they start are rejected or spread over several ticks
+ *
+ * Usage: check
+ *
+ * Build (on any Linux host, WPILib is not needed). TEAM2655_COUNT_ALLOCATIONS is needed for the allocation check
+ * (without it that check is skipped). Never define it for the robot.
+ *     g++ -std=c++14 -O2 -DTEAM2655_COUNT_ALLOCATIONS -I../src check.cpp ../src/team2655/autonomous.cpp \
+ *         ../src/team2655/csvtokenizer.cpp ../src/team2655/compiledscript.cpp ../src/team2655/profiler.cpp \
+ *         ../src/team2655/joystick.cpp ../src/team2655/motionprofile.cpp ../src/team2655/allocationcounter.cpp \
+ *         ../src/team2655/inputfilter.cpp -o check -lpthread
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "AutoSchema.hpp"
+#include "team2655/allocationcounter.hpp"
+#include "team2655/autonomous.hpp"
+#include "team2655/inputfilter.hpp"
+#include "team2655/joystick.hpp"
+#include "team2655/motionprofile.hpp"
+
+using namespace team2655;
+
+// Scripts written by the checks (removed at the end)
+static std::vector<std::string> tempFiles;
+
+// Stops the compiler from optimizing away a value
+static volatile double sink;
+
+static void writeFile(const std::string &path, const std::string &text){
+	tempFiles.push_back(path);
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+}
+
+////////////////////////////////////////////////////////////////////////
+/// Commands and manager used by the autonomous checks
+////////////////////////////////////////////////////////////////////////
+
+// Runs for a number of ticks like a DRIVE without hardware. Counts how many times it was started.
+class TickCommand : public AutoCommand{
+	long remaining = 0;
+public:
+	static long starts;
+
+	std::vector<ArgumentSpec> getArgumentSpecs() override{
+		return { {"direction", ArgumentType::Int}, {"ticks", ArgumentType::Double} };
+	}
+	void start(const std::vector<AutoArgument> &args) override{
+		setTimeout(-1);
+		starts++;
+		remaining = (long)args[1].getDouble();
+	}
+	void process() override{
+		sink = sink + 1;
+		if(--remaining <= 0)
+			doComplete();
+	}
+	void complete() override {  }
+};
+
+long TickCommand::starts = 0;
+
+// Source for the condition used by the allocation check
+static double checkSensor = 0;
+
+// Source for a condition that is always true
+static double checkReady(){
+	return 1;
+}
+
+class CheckAutoManager : public AutoManager{
+	std::string dir;
+public:
+	explicit CheckAutoManager(const std::string &dir) : dir(dir){
+		registerCommand<TickCommand>("DRIVE");
+		registerCommand<TickCommand>("ROTATE");
+		registerCondition("SENSOR", [](){ return checkSensor; }, ConditionType::Rising, 1);
+		registerCondition("READY", checkReady, ConditionType::AtLeast, 1);
+	}
+protected:
+	std::string getScriptDir() override{
+		return dir;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////
+/// Checks
+////////////////////////////////////////////////////////////////////////
+
+// Allocations made where there should be none
+struct AllocationResult{
+	std::string name;
+	long calls;
+	uint64_t allocations;
+	uint64_t worst; // Most in one call
+
+	void record(uint64_t count){
+		calls++;
+		allocations += count;
+		worst = std::max(worst, count);
+	}
+};
+
+/**
+ * Count allocations made by the functions that run in the control loop
+ * @return Did nothing allocate (true if counting is not built in)
+ */
+static bool checkAllocations(const std::string &dir){
+	if(!AllocationCounter::isEnabled()){
+		std::cerr << "Allocation check skipped (build with -DTEAM2655_COUNT_ALLOCATIONS)" << std::endl;
+		return true;
+	}
+
+	// A script using every kind of step: commands, groups, subroutines, loops, and conditions
+	std::string name = "allocations.csv";
+	writeFile(dir + "/" + name,
+			  "DEFINE,turn\nROTATE,1,3\nEND\n"
+			  "DRIVE,-1,5\nREPEAT,4\nCALL,turn\nDRIVE,1,2\nEND\n"
+			  "PARALLEL\nDRIVE,1,4\nSEQUENCE\nROTATE,1,1\nDRIVE,1,2\nEND\nEND\n"
+			  "RACE\nDRIVE,1,1000\nWAIT_UNTIL,SENSOR\nEND\n"
+			  "CALL,turn\n");
+
+	CheckAutoManager manager(dir);
+	ManualAutoClock clock;
+	manager.setClock(&clock);
+	if(!manager.loadScript(name)){
+		std::cerr << "Allocation check failed: its script did not load" << std::endl;
+		return false;
+	}
+
+	std::vector<AllocationResult> results;
+
+	// The first run after loading and a run after restarting
+	AllocationResult process = { "AutoManager::process", 0, 0, 0 };
+	for(int run = 0; run < 2; run++){
+		if(run > 0)
+			manager.restart();
+		checkSensor = 0;
+		bool running = true;
+		while(running){
+			if(process.calls % 50 == 49)
+				checkSensor = 1 - checkSensor;
+			AllocationCounter counter;
+			running = manager.process();
+			process.record(counter.getAllocations());
+			clock.advanceMicros(20000);
+		}
+	}
+	results.push_back(process);
+
+	jshelper::AxisConfig cubic = jshelper::createAxisConfig(0.1, 0.5, 0);
+	AllocationResult axis = { "jshelper::getAxisValue", 0, 0, 0 };
+	for(int i = 0; i <= 1000; i++){
+		AllocationCounter counter;
+		sink = jshelper::getAxisValue(cubic, -1.0 + i / 500.0);
+		axis.record(counter.getAllocations());
+	}
+	results.push_back(axis);
+
+	jshelper::AxisCurve curve = jshelper::AxisCurve::exponential(0.1, 3);
+	AllocationResult curveShape = { "jshelper::AxisCurve::shape", 0, 0, 0 };
+	for(int i = 0; i <= 1000; i++){
+		AllocationCounter counter;
+		sink = curve.shape(-1.0 + i / 500.0);
+		curveShape.record(counter.getAllocations());
+	}
+	results.push_back(curveShape);
+
+	double fitX[] = { 0.1, 0.55, 0.56, 1 }, fitY[] = { 0.5, 0, 0, 1 };
+	std::array<double, 4> coeffs;
+	AllocationResult fit = { "jshelper::polyfit<3>", 0, 0, 0 };
+	for(int i = 0; i < 100; i++){
+		AllocationCounter counter;
+		jshelper::polyfit<3>(fitX, fitY, 4, coeffs);
+		fit.record(counter.getAllocations());
+	}
+	sink = coeffs[0];
+	results.push_back(fit);
+
+	// Every kind of stage on a full driver station
+	InputFilter filter;
+	for(int controller = 0; controller < InputSnapshot::MAX_CONTROLLERS; controller++){
+		filter.addCurve(controller, 1, cubic);
+		filter.addSlewRate(controller, 1, 4);
+		filter.addLowPass(controller, 2, 0.05);
+		filter.addDebounce(controller, 1, 0.05);
+	}
+	InputSnapshot raw, filtered;
+	raw.controllerCount = InputSnapshot::MAX_CONTROLLERS;
+	AllocationResult input = { "InputFilter::apply", 0, 0, 0 };
+	for(int i = 0; i < 100; i++){
+		raw.timeMicros = i * 20000;
+		raw.controllers[0].axes[1] = (i % 10) / 10.0;
+		raw.controllers[0].buttons = i % 3;
+		AllocationCounter counter;
+		filter.apply(raw, filtered);
+		input.record(counter.getAllocations());
+	}
+	sink = filtered.controllers[0].axes[1];
+	results.push_back(input);
+
+	bool none = true;
+	for(const AllocationResult &r : results){
+		std::cerr << r.name << ": " << r.allocations << " allocation(s) in " << r.calls << " calls (most in one call " << r.worst << ")" << std::endl;
+		if(r.allocations != 0){
+			std::cerr << "Allocation check failed: " << r.name << " allocated in the control loop" << std::endl;
+			none = false;
+		}
+	}
+	return none;
+}
+
+// Run the script to its end and return how many commands were started
+static long runToEnd(AutoManager &manager, ManualAutoClock &clock){
+	long before = TickCommand::starts;
+	for(int i = 0; i < 10000 && manager.process(); i++)
+		clock.advanceMicros(20000);
+	return TickCommand::starts - before;
+}
+
+/**
+ * Inject commands then kill, restart, or change the script before they are run
+ * @return Did only the script's own commands run afterwards
+ */
+static bool checkInjectedCommands(const std::string &dir){
+	std::string name = "inject.csv";
+	writeFile(dir + "/" + name, "DRIVE,1,3\n");
+
+	CheckAutoManager manager(dir);
+	ManualAutoClock clock;
+	manager.setClock(&clock);
+	if(!manager.loadScript(name)){
+		std::cerr << "Inject check failed: its script did not load" << std::endl;
+		return false;
+	}
+
+	bool passed = true;
+	auto expect = [&passed](const char *what, long starts){
+		if(starts != 1){
+			std::cerr << "Inject check failed: " << starts << " command(s) ran after " << what << " (expected 1)" << std::endl;
+			passed = false;
+		}
+	};
+
+	// Queued while running, then killed before the next tick
+	manager.process();
+	manager.injectCommand("DRIVE", { "1", "3" });
+	manager.killAuto();
+	manager.restart();
+	expect("injecting then killing and restarting", runToEnd(manager, clock));
+
+	// Added to a finished script, then restarted
+	manager.injectCommand("DRIVE", { "1", "3" });
+	manager.process();
+	manager.restart();
+	expect("injecting after the end then restarting", runToEnd(manager, clock));
+
+	// Queued, then a script is loaded
+	manager.injectCommand("DRIVE", { "1", "3" });
+	manager.loadScript(name);
+	expect("injecting then loading a script", runToEnd(manager, clock));
+
+	// Queued, then a script is selected
+	manager.injectCommand("DRIVE", { "1", "3" });
+	manager.selectScript(name);
+	expect("injecting then selecting a script", runToEnd(manager, clock));
+
+	// Still added while running
+	manager.restart();
+	manager.process();
+	manager.injectCommand("DRIVE", { "1", "3" });
+	long starts = 1 + runToEnd(manager, clock);
+	if(starts != 2){
+		std::cerr << "Inject check failed: " << starts << " command(s) ran with one injected while running (expected 2)" << std::endl;
+		passed = false;
+	}
+	return passed;
+}
+
+/**
+ * Loops whose steps finish as soon as they start
+ * @return Were empty groups rejected and were loops of already true WAIT_UNTILs spread over several ticks
+ */
+static bool checkInstantLoops(const std::string &dir){
+	CheckAutoManager manager(dir);
+	ManualAutoClock clock;
+	manager.setClock(&clock);
+	bool passed = true;
+
+	// Would hand over 100 million times in one tick
+	std::string empty = "empty-group.csv";
+	writeFile(dir + "/" + empty, "REPEAT,10000\nREPEAT,10000\nSEQUENCE\nEND\nEND\nEND\n");
+	if(manager.loadScript(empty)){
+		std::cerr << "Instant loop check failed: a loop of an empty group was not rejected" << std::endl;
+		passed = false;
+	}
+
+	// 10000 WAIT_UNTILs that are all true. Each tick hands over at most once per step in the script (5 of them).
+	std::string waits = "ready-waits.csv";
+	writeFile(dir + "/" + waits, "REPEAT,100\nREPEAT,100\nWAIT_UNTIL,READY\nEND\nEND\n");
+	if(!manager.loadScript(waits)){
+		std::cerr << "Instant loop check failed: its script did not load" << std::endl;
+		return false;
+	}
+	long ticks = 0;
+	while(ticks < 100000 && manager.process()){
+		ticks++;
+		clock.advanceMicros(20000);
+	}
+	if(ticks < 10000 / 6 || ticks >= 100000){
+		std::cerr << "Instant loop check failed: 10000 WAIT_UNTILs took " << ticks << " ticks (expected 1667 to 10000)" << std::endl;
+		passed = false;
+	}
+	return passed;
+}
+
+/**
+ * Fit the points createAxisConfig uses for deadbands up to 0.999 (the points get closer together as the deadband grows,
+ * which makes the fit harder) with both versions of polyfit
+ * @return Did the fixed order polyfit stay accurate
+ */
+static bool checkPolyfit(){
+	const double TOLERANCE = 1e-4;
+	bool accurate = true;
+	for(double deadband : { 0.1, 0.9, 0.99, 0.999 }){
+		double mid = (1 - deadband) / 2 + deadband;
+		std::vector<double> x = { deadband, mid, mid + 0.01 * (1 - deadband), 1 };
+		std::vector<double> y = { 0.5, 0.2, 0.2, 1 };
+
+		std::vector<double> vectorCoeffs;
+		std::array<double, 4> fixedCoeffs;
+		bool vectorFit = jshelper::polyfit<double>(x, y, 3, vectorCoeffs);
+		bool fixedFit = jshelper::polyfit<3>(x.data(), y.data(), x.size(), fixedCoeffs);
+
+		double vectorError = vectorFit ? 0 : INFINITY, fixedError = fixedFit ? 0 : INFINITY;
+		for(size_t i = 0; i < x.size(); i++){
+			if(vectorFit){
+				double value = ((vectorCoeffs[3] * x[i] + vectorCoeffs[2]) * x[i] + vectorCoeffs[1]) * x[i] + vectorCoeffs[0];
+				vectorError = std::max(vectorError, std::fabs(value - y[i]));
+			}
+			if(fixedFit){
+				double value = ((fixedCoeffs[3] * x[i] + fixedCoeffs[2]) * x[i] + fixedCoeffs[1]) * x[i] + fixedCoeffs[0];
+				fixedError = std::max(fixedError, std::fabs(value - y[i]));
+			}
+		}
+
+		std::ostringstream param;
+		param << "deadband " << deadband;
+		std::cerr << "jshelper::polyfit [" << param.str() << "]: error " << vectorError << ", polyfit<3>: error " << fixedError << std::endl;
+		if(!(fixedError <= TOLERANCE)){
+			std::cerr << "Accuracy check failed: polyfit<3> is off by " << fixedError << " with a " << param.str() << std::endl;
+			accurate = false;
+		}
+	}
+	return accurate;
+}
+
+// Rest to rest minimum time for a move with velocity, acceleration and jerk (0 for none) limits
+static double minimumProfileTime(double distance, const ProfileLimits &limits){
+	double d = std::fabs(distance), v = limits.maxVelocity, a = limits.maxAcceleration, j = limits.maxJerk;
+	if(d == 0)
+		return 0;
+	if(j == 0)
+		return (d >= v * v / a) ? d / v + v / a : 2 * std::sqrt(d / a);
+	if(v * j >= a * a){
+		if(d >= v * (v / a + a / j))
+			return d / v + v / a + a / j; // Reaches the velocity and acceleration limits
+		double peak = (-a * a / j + std::sqrt(a * a * a * a / (j * j) + 4 * a * d)) / 2;
+		if(peak >= a * a / j)
+			return 2 * (peak / a + a / j); // Reaches the acceleration limit only
+	}else if(d >= 2 * v * std::sqrt(v / j)){
+		return d / v + 2 * std::sqrt(v / j); // Reaches the velocity limit only
+	}
+	return 4 * std::cbrt(d / (2 * j)); // Reaches neither
+}
+
+/**
+ * Check generated profiles against the limits they were generated with (velocity, acceleration and jerk from the table),
+ * that they end at the target, and that they take the analytic minimum time. The S-curve is only time optimal for moves
+ * that reach the velocity limit (shorter ones cruise for at least one window), so shorter moves are only checked to
+ * never be faster than the minimum (that would mean a limit was broken).
+ * @return Were all of the profiles within their limits
+ */
+static bool checkMotionProfiles(){
+	struct ProfileCase{
+		const char *name;
+		ProfileLimits limits;
+		std::vector<double> distances;
+	};
+	// The robot's limits (AutoSchema.hpp) and a trapezoid with the drive's velocity and acceleration
+	std::vector<ProfileCase> cases = {
+		{ "drive", AutoSchema::driveLimits, { 0.05, 0.5, 1, 2, -3, 30 } },
+		{ "rotate", AutoSchema::rotateLimits, { 1, 10, 45, -90, 180, 720 } },
+		{ "trapezoid", ProfileLimits(AutoSchema::driveLimits.maxVelocity, AutoSchema::driveLimits.maxAcceleration), { 0.05, 0.5, 2, -3, 30 } }
+	};
+
+	bool valid = true;
+	for(const ProfileCase &c : cases){
+		const ProfileLimits &limits = c.limits;
+		for(double distance : c.distances){
+			std::ostringstream param;
+			param << c.name << " " << distance;
+			MotionProfile profile;
+			if(!profile.generate(distance, limits)){
+				std::cerr << "Profile check failed: " << param.str() << " could not be generated" << std::endl;
+				valid = false;
+				continue;
+			}
+
+			// Velocities at the table's samples. Acceleration and jerk are their differences.
+			size_t count = profile.getSampleCount();
+			double dt = profile.getDuration() / (count - 1);
+			std::vector<double> velocities(count);
+			for(size_t i = 0; i < count; i++)
+				velocities[i] = profile.sample(std::min(i * dt, profile.getDuration() * (1 - 1e-12))).velocity;
+			double maxVelocity = 0, maxAcceleration = 0, maxJerk = 0;
+			for(size_t i = 0; i < count; i++){
+				maxVelocity = std::max(maxVelocity, std::fabs(velocities[i]));
+				if(i + 1 < count)
+					maxAcceleration = std::max(maxAcceleration, std::fabs(velocities[i + 1] - velocities[i]) / dt);
+				if(i + 2 < count)
+					maxJerk = std::max(maxJerk, std::fabs(velocities[i + 2] - 2 * velocities[i + 1] + velocities[i]) / (dt * dt));
+			}
+
+			// The table is stored as floats, so allow a little over the limits
+			const double SLACK = 1.01;
+			double endError = std::fabs(profile.sample(profile.getDuration() * (1 - 1e-12)).position - distance);
+			double minimum = minimumProfileTime(distance, limits);
+			double reachesVelocity = (limits.maxJerk > 0) ? limits.maxVelocity * (limits.maxVelocity / limits.maxAcceleration +
+					limits.maxAcceleration / limits.maxJerk) : limits.maxVelocity * limits.maxVelocity / limits.maxAcceleration;
+			bool optimal = std::fabs(distance) >= reachesVelocity &&
+					(limits.maxJerk == 0 || limits.maxVelocity * limits.maxJerk >= limits.maxAcceleration * limits.maxAcceleration);
+
+			std::vector<std::string> problems;
+			if(maxVelocity > limits.maxVelocity * SLACK)
+				problems.push_back("velocity " + std::to_string(maxVelocity));
+			if(maxAcceleration > limits.maxAcceleration * SLACK)
+				problems.push_back("acceleration " + std::to_string(maxAcceleration));
+			if(limits.maxJerk > 0 && maxJerk > limits.maxJerk * SLACK)
+				problems.push_back("jerk " + std::to_string(maxJerk));
+			if(!(endError <= 1e-5 * std::max(1.0, std::fabs(distance))))
+				problems.push_back("ends " + std::to_string(endError) + " from the target");
+			if(optimal ? !(std::fabs(profile.getDuration() - minimum) <= 1e-9 * minimum) : !(profile.getDuration() >= minimum * (1 - 1e-9)))
+				problems.push_back("takes " + std::to_string(profile.getDuration()) + "s (minimum " + std::to_string(minimum) + "s)");
+
+			std::cerr << "MotionProfile [" << param.str() << "]: velocity " << maxVelocity << ", acceleration " << maxAcceleration
+					  << ", jerk " << maxJerk << ", " << profile.getDuration() << "s (minimum " << minimum << "s)" << std::endl;
+			for(const std::string &problem : problems){
+				std::cerr << "Profile check failed: " << param.str() << ": " << problem << std::endl;
+				valid = false;
+			}
+		}
+	}
+
+	// Distances that can not be driven are rejected instead of generating a huge (or endless) table
+	for(double distance : { (double)NAN, (double)INFINITY, 1e6 }){
+		MotionProfile profile;
+		if(profile.generate(distance, cases[0].limits) || profile.getSampleCount() != 0){
+			std::cerr << "Profile check failed: a distance of " << distance << " was not rejected" << std::endl;
+			valid = false;
+		}
+	}
+	return valid;
+}
+
+int main(){
+	// Scripts are written to a temporary directory
+	char dirTemplate[] = "/tmp/team2655-check-XXXXXX";
+	if(mkdtemp(dirTemplate) == nullptr){
+		std::cerr << "Could not create a temporary directory" << std::endl;
+		return 1;
+	}
+	std::string dir = dirTemplate;
+
+	bool passed = true;
+	passed &= checkAllocations(dir);
+	passed &= checkInjectedCommands(dir);
+	passed &= checkInstantLoops(dir);
+	passed &= checkPolyfit();
+	passed &= checkMotionProfiles();
+
+	for(const std::string &file : tempFiles)
+		unlink(file.c_str());
+	rmdir(dir.c_str());
+
+	std::cerr << (passed ? "All checks passed" : "Some checks failed") << std::endl;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/**
+ * fitcurve.cpp
+ * Fits a joystick axis curve (jshelper::AxisConfig) to telemetry logs (.tlm) recorded on the robot
+ * Each log is read on its own thread into its own CurveFitter, then the fitters are merged. Records are fitted as
+ * they are read, so the number of records does not change how much memory the fit uses.
+ * If the logs have a "mode" channel only teleop records (mode 2) are used.
+ *
+ * Usage: fitcurve [-x channel] [-y channel] [-d deadband] log.tlm [more.tlm ...]
+ *     -x  The raw axis channel (default axis_speed)
+ *     -y  The output wanted for it (default speed)
+ *     -d  The deadband of the fitted config (default 0.1)
+ *
+ * Build (on any Linux host, WPILib is not needed):
+ *     g++ -std=c++14 -O2 -I../src fitcurve.cpp ../src/team2655/joystick.cpp ../src/team2655/telemetry.cpp -o fitcurve -lpthread
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "team2655/joystick.hpp"
+#include "team2655/telemetry.hpp"
+
+using namespace team2655;
+
+// The index of a channel in a log (-1 if it is not there)
+static int findChannel(const TelemetryReader &reader, const std::string &name){
+	const std::vector<telemetry::Channel> &channels = reader.getChannels();
+	for(size_t i = 0; i < channels.size(); i++){
+		if(channels[i].name == name)
+			return i;
+	}
+	return -1;
+}
+
+// Fit every record of one log
+static bool fitLog(const std::string &path, const std::string &xName, const std::string &yName, jshelper::CurveFitter &fitter){
+	TelemetryReader reader;
+	if(!reader.open(path))
+		return false;
+
+	int xChannel = findChannel(reader, xName);
+	int yChannel = findChannel(reader, yName);
+	int modeChannel = findChannel(reader, "mode");
+	if(xChannel < 0 || yChannel < 0){
+		std::cerr << path << " does not have the channels \"" << xName << "\" and \"" << yName << "\"" << std::endl;
+		return false;
+	}
+
+	telemetry::Record record;
+	while(reader.next(record)){
+		if(modeChannel < 0 || record.values[modeChannel] == 2)
+			fitter.add(record.values[xChannel], record.values[yChannel]);
+	}
+	if(reader.isTruncated())
+		std::cerr << path << " ends part way through a record (the rest of it was used)" << std::endl;
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	std::string xName = "axis_speed", yName = "speed";
+	double deadband = 0.1;
+	std::vector<std::string> logs;
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "-x" && i + 1 < argc){
+			xName = argv[++i];
+		}else if(arg == "-y" && i + 1 < argc){
+			yName = argv[++i];
+		}else if(arg == "-d" && i + 1 < argc){
+			deadband = std::atof(argv[++i]);
+		}else if(arg == "-h" || arg == "--help"){
+			logs.clear();
+			break;
+		}else{
+			logs.push_back(arg);
+		}
+	}
+
+	if(logs.empty() || !(deadband >= 0 && deadband < 1)){
+		std::cerr << "Usage: fitcurve [-x channel] [-y channel] [-d deadband] log.tlm [more.tlm ...]" << std::endl;
+		return 2;
+	}
+
+	// One fitter per log so the threads share nothing until they are merged
+	std::vector<jshelper::CurveFitter> fitters(logs.size(), jshelper::CurveFitter(deadband));
+	std::vector<char> fitted(logs.size(), false);
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < logs.size(); i++){
+		threads.push_back(std::thread([&, i](){
+			fitted[i] = fitLog(logs[i], xName, yName, fitters[i]);
+		}));
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+
+	jshelper::CurveFitter fitter(deadband);
+	int failed = 0;
+	for(size_t i = 0; i < logs.size(); i++){
+		if(fitted[i]){
+			fitter.merge(fitters[i]);
+		}else{
+			failed++; // fitLog already printed the reason
+		}
+	}
+
+	jshelper::AxisConfig config;
+	if(!fitter.getConfig(config)){
+		std::cerr << "Not enough different axis values to fit (" << fitter.getSampleCount() << " samples)" << std::endl;
+		return 1;
+	}
+
+	// Ready to paste into OI.cpp
+	std::cout << "// Fitted to " << fitter.getSampleCount() << " samples of " << yName << " vs " << xName << std::endl;
+	std::cout << std::setprecision(17) << "jshelper::AxisConfig{{ " << config[0] << ", " << config[1] << ", " << config[2]
+			<< ", " << config[3] << ", " << config[4] << " }}" << std::endl;
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+/**
+ * telemetry2csv.cpp
+ * Converts a telemetry log (.tlm) written by TelemetryLogger on the robot to CSV
+ * Copy logs off the roboRIO with SFTP (see Robot.cpp for the path).
+ *
+ * Usage: telemetry2csv log.tlm [out.csv]      Prints to stdout if no output file is given
+ *
+ * Columns: time (seconds since the log was started), dropped (records lost just before this row), then one per channel.
+ *
+ * Build (on any Linux host, WPILib is not needed):
+ *     g++ -std=c++14 -O2 -I../src telemetry2csv.cpp ../src/team2655/telemetry.cpp -o telemetry2csv -lpthread
+ *
+ * Copyright (c) 2018 FRC Team 2655 - The Flying Platypi
+ * See LICENSE file for details
+ */
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "team2655/telemetry.hpp"
+
+using namespace team2655;
+
+int main(int argc, char *argv[]){
+	if(argc < 2 || argc > 3){
+		std::cerr << "Usage: telemetry2csv log.tlm [out.csv]" << std::endl;
+		return 2;
+	}
+
+	TelemetryReader reader;
+	if(!reader.open(argv[1]))
+		return 1;
+
+	std::ofstream file;
+	if(argc > 2){
+		file.open(argv[2]);
+		if(!file){
+			std::cerr << "Could not create " << argv[2] << std::endl;
+			return 1;
+		}
+	}
+	std::ostream &out = (argc > 2) ? file : std::cout;
+	out.precision(std::numeric_limits<double>::digits10);
+
+	const std::vector<telemetry::Channel> &channels = reader.getChannels();
+	out << "time,dropped";
+	for(const telemetry::Channel &channel : channels)
+		out << "," << channel.name;
+	out << "\n";
+
+	telemetry::Record record;
+	long rows = 0;
+	uint64_t dropped = 0;
+	while(reader.next(record)){
+		out << (record.timeMicros - reader.getStartMicros()) / 1e6 << "," << record.dropped;
+		for(size_t i = 0; i < channels.size(); i++)
+			out << "," << record.values[i];
+		out << "\n";
+		rows++;
+		dropped += record.dropped;
+	}
+
+	std::cerr << rows << " records";
+	if(dropped > 0)
+		std::cerr << " (" << dropped << " dropped on the robot)";
+	if(reader.isTruncated())
+		std::cerr << ". The log ends part way through a record (the rest was not written).";
+	std::cerr << std::endl;
+	return 0;
+}